@@ -27,6 +27,14 @@ CREATE FUNCTION curl_mime_file(data text, name text DEFAULT null, file text DEFA
 
 CREATE FUNCTION curl_easy_setopt_postfields(parameter bytea, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_postfields' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_setopt_readdata(parameter bytea, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_readdata' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_readquery(query text, format text DEFAULT 'csv', conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_readquery' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_max_header_bytes(parameter bigint, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_max_header_bytes' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_max_response_bytes(parameter bigint, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_max_response_bytes' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_backoff(multiplier float8 DEFAULT 2, max bigint DEFAULT 60000000, jitter float8 DEFAULT 0.5, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_backoff' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_retry_status(codes int[] DEFAULT '{429,503}', any_method boolean DEFAULT false, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_retry_status' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_sink_file(path text, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_sink_file' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_sink_lo(loid oid, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_sink_lo' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_setopt_sink_tempfile(conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_sink_tempfile' LANGUAGE 'c';
 
 CREATE FUNCTION curl_easy_setopt_abstract_unix_socket(parameter text, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_abstract_unix_socket' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_setopt_accept_encoding(parameter text, conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_setopt_accept_encoding' LANGUAGE 'c';
@@ -235,6 +243,60 @@ CREATE FUNCTION curl_easy_setopt_wildcardmatch(parameter bigint, conname NAME DE
 CREATE FUNCTION curl_multi_add_handle(conname NAME DEFAULT NULL) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_multi_add_handle' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_perform(try int DEFAULT 1, sleep bigint DEFAULT 1000000, timeout_ms int DEFAULT 1000) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_easy_perform' LANGUAGE 'c';
 CREATE FUNCTION curl_multi_perform(try int DEFAULT 1, sleep bigint DEFAULT 1000000, timeout_ms int DEFAULT 1000) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_multi_perform' LANGUAGE 'c';
+CREATE FUNCTION curl_multi_batch(urls text[], methods text[] DEFAULT NULL, bodies bytea[] DEFAULT NULL, headers jsonb[] DEFAULT NULL, try int DEFAULT 1, sleep bigint DEFAULT 1000000, timeout_ms int DEFAULT 1000, OUT index int, OUT errcode bigint, OUT errbuf text, OUT response_code bigint, OUT header_in text, OUT data_in bytea, OUT namelookup_time float8, OUT connect_time float8, OUT appconnect_time float8, OUT starttransfer_time float8, OUT total_time float8) RETURNS SETOF record AS 'MODULE_PATHNAME', 'pg_curl_multi_batch' LANGUAGE 'c';
+CREATE FUNCTION curl_multi_info_read(try int DEFAULT 1, sleep bigint DEFAULT 1000000, timeout_ms int DEFAULT 1000, OUT conname NAME, OUT errcode bigint, OUT response_code bigint, OUT total_time float8) RETURNS SETOF record AS 'MODULE_PATHNAME', 'pg_curl_multi_info_read' LANGUAGE 'c';
+
+CREATE FUNCTION curl_share_setopt_share(parameter bigint) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_share_setopt_share' LANGUAGE 'c';
+CREATE FUNCTION curl_share_setopt_unshare(parameter bigint) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_share_setopt_unshare' LANGUAGE 'c';
+CREATE FUNCTION curl_multi_setopt_max_concurrent_streams(parameter bigint) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_multi_setopt_max_concurrent_streams' LANGUAGE 'c';
+CREATE FUNCTION curl_multi_setopt_max_host_connections(parameter bigint) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_multi_setopt_max_host_connections' LANGUAGE 'c';
+CREATE FUNCTION curl_multi_setopt_max_total_connections(parameter bigint) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_multi_setopt_max_total_connections' LANGUAGE 'c';
+CREATE FUNCTION curl_multi_setopt_maxconnects(parameter bigint) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_multi_setopt_maxconnects' LANGUAGE 'c';
+CREATE FUNCTION curl_multi_setopt_pipelining(parameter bigint) RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_multi_setopt_pipelining' LANGUAGE 'c';
+CREATE FUNCTION curl_share_cleanup() RETURNS boolean AS 'MODULE_PATHNAME', 'pg_curl_share_cleanup' LANGUAGE 'c';
+CREATE FUNCTION curl_global_memory(OUT allocations bigint, OUT frees bigint, OUT reallocations bigint, OUT allocated bigint, OUT threaded boolean) RETURNS record AS 'MODULE_PATHNAME', 'pg_curl_global_memory' LANGUAGE 'c';
+CREATE FUNCTION curl_global_aborted(OUT header bigint, OUT response bigint) RETURNS record AS 'MODULE_PATHNAME', 'pg_curl_global_aborted' LANGUAGE 'c';
+CREATE FUNCTION curl_rate_limit_state(OUT host text, OUT rate float8, OUT burst float8, OUT tokens float8, OUT granted bigint, OUT delayed bigint, OUT updated timestamptz) RETURNS SETOF record AS 'MODULE_PATHNAME', 'pg_curl_rate_limit_state' LANGUAGE 'c';
+CREATE VIEW curl_rate_limit AS SELECT * FROM curl_rate_limit_state();
+CREATE FUNCTION curl_breaker_state(OUT host text, OUT state text, OUT requests bigint, OUT failures bigint, OUT rejected bigint, OUT opened timestamptz, OUT window_start timestamptz) RETURNS SETOF record AS 'MODULE_PATHNAME', 'pg_curl_breaker_state' LANGUAGE 'c';
+CREATE VIEW curl_breaker AS SELECT * FROM curl_breaker_state();
+CREATE FUNCTION curl_copy_from(url text, target regclass, format text DEFAULT NULL, options jsonb DEFAULT NULL, conname NAME DEFAULT NULL) RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_copy_from' LANGUAGE 'c';
+CREATE FUNCTION curl_stream_lines(conname NAME DEFAULT NULL) RETURNS SETOF text AS 'MODULE_PATHNAME', 'pg_curl_stream_lines' LANGUAGE 'c';
+CREATE FUNCTION curl_stream_jsonb(conname NAME DEFAULT NULL) RETURNS SETOF jsonb AS 'MODULE_PATHNAME', 'pg_curl_stream_jsonb' LANGUAGE 'c';
+CREATE FUNCTION curl_stream_sse(max_rows BIGINT DEFAULT NULL, max_time_ms INT DEFAULT NULL, last_event_id TEXT DEFAULT NULL, conname NAME DEFAULT NULL, OUT id TEXT, OUT event TEXT, OUT data TEXT) RETURNS SETOF record AS 'MODULE_PATHNAME', 'pg_curl_stream_sse' LANGUAGE 'c';
+CREATE FUNCTION curl_ws_send(payload BYTEA, opcode TEXT DEFAULT 'binary', conname NAME DEFAULT NULL) RETURNS bool AS 'MODULE_PATHNAME', 'pg_curl_ws_send' LANGUAGE 'c';
+CREATE FUNCTION curl_ws_send(payload TEXT, opcode TEXT DEFAULT 'text', conname NAME DEFAULT NULL) RETURNS bool AS 'MODULE_PATHNAME', 'pg_curl_ws_send_text' LANGUAGE 'c';
+CREATE FUNCTION curl_ws_recv(timeout_ms INT DEFAULT 1000, max_messages BIGINT DEFAULT NULL, conname NAME DEFAULT NULL, OUT opcode TEXT, OUT payload BYTEA) RETURNS SETOF record AS 'MODULE_PATHNAME', 'pg_curl_ws_recv' LANGUAGE 'c';
+CREATE FUNCTION curl_ws_close(conname NAME DEFAULT NULL) RETURNS bool AS 'MODULE_PATHNAME', 'pg_curl_ws_close' LANGUAGE 'c';
+
+CREATE FUNCTION curl_worker_perform(url text, method text DEFAULT NULL, body bytea DEFAULT NULL, headers jsonb DEFAULT NULL, timeout_ms int DEFAULT 0, OUT errcode bigint, OUT errbuf text, OUT response_code bigint, OUT header_in text, OUT data_in bytea, OUT total_time float8) RETURNS record AS 'MODULE_PATHNAME', 'pg_curl_worker_perform' LANGUAGE 'c';
+
+CREATE TABLE curl_async (
+    id bigserial PRIMARY KEY,
+    url text NOT NULL,
+    method text,
+    body bytea,
+    headers jsonb CHECK (jsonb_typeof(headers) = 'object'),
+    try int NOT NULL DEFAULT 1 CHECK (try > 0),
+    sleep bigint NOT NULL DEFAULT 1000000 CHECK (sleep >= 0),
+    timeout_ms int NOT NULL DEFAULT 0,
+    submitted timestamptz NOT NULL DEFAULT now(),
+    started timestamptz,
+    finished timestamptz,
+    errcode bigint,
+    errbuf text,
+    response_code bigint,
+    header_in text,
+    data_in bytea,
+    total_time float8
+);
+CREATE INDEX curl_async_started_idx ON curl_async (id) WHERE started IS NULL;
+SELECT pg_catalog.pg_extension_config_dump('curl_async', '');
+SELECT pg_catalog.pg_extension_config_dump('curl_async_id_seq', '');
+CREATE FUNCTION curl_async_trigger() RETURNS trigger AS 'MODULE_PATHNAME', 'pg_curl_async_trigger' LANGUAGE 'c';
+CREATE TRIGGER curl_async_trigger BEFORE INSERT ON curl_async FOR EACH ROW EXECUTE PROCEDURE curl_async_trigger();
+CREATE FUNCTION curl_async_submit(url text, method text DEFAULT NULL, body bytea DEFAULT NULL, headers jsonb DEFAULT NULL, try int DEFAULT 1, sleep bigint DEFAULT 1000000, timeout_ms int DEFAULT 0) RETURNS bigint AS $$INSERT INTO @extschema@.curl_async (url, method, body, headers, try, sleep, timeout_ms) VALUES ($1, $2, $3, $4, $5, $6, $7) RETURNING id$$ LANGUAGE sql;
+CREATE FUNCTION curl_async_result(id bigint) RETURNS curl_async AS $$SELECT * FROM @extschema@.curl_async WHERE id = $1$$ LANGUAGE sql STABLE;
 
 CREATE FUNCTION curl_easy_getinfo_headers(conname NAME DEFAULT NULL) RETURNS text AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_headers' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_getinfo_response(conname NAME DEFAULT NULL) RETURNS bytea AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_response' LANGUAGE 'c';
@@ -244,6 +306,14 @@ CREATE FUNCTION curl_easy_getinfo_header_in(conname NAME DEFAULT NULL) RETURNS t
 CREATE FUNCTION curl_easy_getinfo_header_out(conname NAME DEFAULT NULL) RETURNS text AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_header_out' LANGUAGE 'c';
 
 CREATE FUNCTION curl_easy_getinfo_data_in(conname NAME DEFAULT NULL) RETURNS bytea AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_data_in' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_data_in_chunks(size int DEFAULT 1048576, conname NAME DEFAULT NULL) RETURNS SETOF bytea AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_data_in_chunks' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_data_in_take(conname NAME DEFAULT NULL) RETURNS bytea AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_data_in_take' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_data_in_json(conname NAME DEFAULT NULL) RETURNS json AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_data_in_json' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_data_in_jsonb(conname NAME DEFAULT NULL) RETURNS jsonb AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_data_in_jsonb' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_data_in_text(encoding text DEFAULT 'utf-8', conname NAME DEFAULT NULL) RETURNS text AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_data_in_text' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_headers_table(conname NAME DEFAULT NULL, OUT name text, OUT value text, OUT response_index int) RETURNS SETOF record AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_headers_table' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_headers_jsonb(conname NAME DEFAULT NULL) RETURNS jsonb AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_headers_jsonb' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_header(name text, conname NAME DEFAULT NULL) RETURNS text AS 'MODULE_PATHNAME', 'pg_curl_easy_header' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_getinfo_data_out(conname NAME DEFAULT NULL) RETURNS bytea AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_data_out' LANGUAGE 'c';
 
 CREATE FUNCTION curl_easy_getinfo_content_type(conname NAME DEFAULT NULL) RETURNS text AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_content_type' LANGUAGE 'c';
@@ -259,6 +329,7 @@ CREATE FUNCTION curl_easy_getinfo_scheme(conname NAME DEFAULT NULL) RETURNS text
 
 CREATE FUNCTION curl_easy_getinfo_activesocket(conname NAME DEFAULT NULL) RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_activesocket' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_getinfo_condition_unmet(conname NAME DEFAULT NULL) RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_condition_unmet' LANGUAGE 'c';
+CREATE FUNCTION curl_easy_getinfo_attempts(conname NAME DEFAULT NULL) RETURNS int AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_attempts' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_getinfo_errcode(conname NAME DEFAULT NULL) RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_errcode' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_getinfo_filetime(conname NAME DEFAULT NULL) RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_filetime' LANGUAGE 'c';
 CREATE FUNCTION curl_easy_getinfo_header_size(conname NAME DEFAULT NULL) RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_easy_getinfo_header_size' LANGUAGE 'c';
@@ -289,6 +360,9 @@ CREATE FUNCTION curl_http_version_2tls() RETURNS bigint AS 'MODULE_PATHNAME', 'p
 CREATE FUNCTION curl_http_version_3() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_http_version_3' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
 CREATE FUNCTION curl_http_version_none() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_http_version_none' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
 
+CREATE FUNCTION curlpipe_nothing() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curlpipe_nothing' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+CREATE FUNCTION curlpipe_multiplex() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curlpipe_multiplex' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
 CREATE FUNCTION curlusessl_none() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curlusessl_none' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
 CREATE FUNCTION curlusessl_try() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curlusessl_try' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
 CREATE FUNCTION curlusessl_control() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curlusessl_control' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
@@ -427,4 +501,10 @@ CREATE FUNCTION curlftp_create_dir() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_cu
 CREATE FUNCTION curlftp_create_dir_retry() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curlftp_create_dir_retry' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
 CREATE FUNCTION curlftp_create_dir_none() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curlftp_create_dir_none' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
 
+CREATE FUNCTION curl_lock_data_cookie() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_lock_data_cookie' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+CREATE FUNCTION curl_lock_data_dns() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_lock_data_dns' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+CREATE FUNCTION curl_lock_data_ssl_session() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_lock_data_ssl_session' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+CREATE FUNCTION curl_lock_data_connect() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_lock_data_connect' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+CREATE FUNCTION curl_lock_data_psl() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_lock_data_psl' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
 CREATE FUNCTION curl_max_write_size() RETURNS bigint AS 'MODULE_PATHNAME', 'pg_curl_max_write_size' LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
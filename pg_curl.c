@@ -1,28 +1,101 @@
 #include <postgres.h>
 
+#include <access/htup_details.h>
+#if PG_VERSION_NUM >= 120000
+#include <access/table.h>
+#endif
+#include <access/xact.h>
+#if PG_VERSION_NUM >= 110000
+#include <catalog/pg_authid.h>
+#endif
+#include <catalog/pg_type.h>
+#include <commands/copy.h>
+#include <commands/extension.h>
+#include <commands/trigger.h>
+#if PG_VERSION_NUM >= 150000
+#include <common/pg_prng.h>
+#endif
+#include <executor/executor.h>
+#include <executor/spi.h>
+#include <funcapi.h>
+#include <lib/pairingheap.h>
 #include <lib/stringinfo.h>
+#include <mb/pg_wchar.h>
+#include <libpq/libpq-fs.h>
 #include <miscadmin.h>
+#include <nodes/makefuncs.h>
+#include <parser/parse_node.h>
+#include <parser/parse_relation.h>
+#include <pgstat.h>
+#include <postmaster/bgworker.h>
+#include <storage/buffile.h>
+#include <storage/dsm.h>
+#include <storage/fd.h>
+#include <storage/ipc.h>
+#include <storage/large_object.h>
+#include <storage/latch.h>
+#include <storage/lwlock.h>
+#include <storage/proc.h>
+#include <storage/shm_mq.h>
+#include <storage/shmem.h>
+#include <storage/spin.h>
+#include <tcop/tcopprot.h>
+#include <utils/acl.h>
+#include <utils/array.h>
 #include <utils/builtins.h>
 #include <utils/guc.h>
 #include <utils/hsearch.h>
+#include <utils/json.h>
+#include <utils/jsonb.h>
+#include <utils/lsyscache.h>
 #include <utils/memutils.h>
+#include <utils/numeric.h>
+#include <utils/rls.h>
+#include <utils/snapmgr.h>
+#include <utils/timestamp.h>
 
+#include <arpa/inet.h>
 #include <curl/curl.h>
 #include <pthread.h>
 
 #define EXTENSION(function) Datum (function)(PG_FUNCTION_ARGS); PG_FUNCTION_INFO_V1(function); Datum (function)(PG_FUNCTION_ARGS)
 
+#if PG_VERSION_NUM < 90500
+#define MCXT_ALLOC_HUGE 0x01
+#define MCXT_ALLOC_NO_OOM 0x02
+#define MCXT_ALLOC_ZERO 0x04
+#define MemoryContextAllocExtended(context, size, flags) (((flags) & MCXT_ALLOC_ZERO) ? MemoryContextAllocZero((context), (size)) : MemoryContextAlloc((context), (size)))
+#endif
+
 PG_MODULE_MAGIC;
 
 typedef struct {
+    bool probe; // let through half-open circuit breaker
+    bool readeof;
+    bool readheader;
+    bool rejected; // retry completed by open circuit breaker without transfer
+    bool reserved; // granted rate limit token while waiting in retry heap
+    bool waiting; // in retry heap
+    bool ws;
     char errbuf[CURL_ERROR_SIZE];
+    char readcursor[NAMEDATALEN];
+    char readformat;
+    const char *conname;
+    const char *limit;
     CURLcode errcode;
     CURL *easy;
     CURLM *multi;
 #if CURL_AT_LEAST_VERSION(7, 56, 0)
     curl_mime *mime;
 #endif
+    ErrorData *error; // thrown by a callback, re-thrown after libcurl returned
+    int index;
     int try;
+    int64 max_header_bytes;
+    int64 max_response_bytes;
+    int64 received;
+    MemoryContext data_in_context;
+    pairingheap_node retry;
     StringInfoData data_in;
     StringInfoData data_out;
     StringInfoData debug;
@@ -31,6 +104,24 @@ typedef struct {
     StringInfoData postfield;
     StringInfoData readdata;
     StringInfoData url;
+    struct {
+        double jitter;
+        double multiplier;
+        int64 max;
+    } backoff;
+    struct {
+        bool any_method;
+        Bitmapset *status; // response codes to retry, NULL disables
+    } retry_http;
+    struct {
+        BufFile *buffile;
+        char kind;
+        char *path;
+        FILE *file;
+        LargeObjectDesc *lo;
+        LocalTransactionId lxid;
+        Oid loid;
+    } sink;
     struct curl_slist *header;
     struct curl_slist *postquote;
     struct curl_slist *prequote;
@@ -38,6 +129,7 @@ typedef struct {
 #if CURL_AT_LEAST_VERSION(7, 20, 0)
     struct curl_slist *recipient;
 #endif
+    TimestampTz retry_at;
 } pg_curl_t;
 
 typedef struct {
@@ -45,17 +137,85 @@ typedef struct {
     pg_curl_t *curl;
 } pg_curl_hash_t;
 
+typedef struct {
+    bool last; // of its handle, which takes it over after commit
+    MemoryContext context;
+    pg_curl_t *curl; // snapshot of the handle at curl_multi_add_handle
+    pg_curl_t *origin;
+    SubTransactionId subid;
+} pg_curl_deferred_t;
+
 static struct {
+    bool deferred;
+    bool detached; // a resolver thread may outlive its handle, so keep locking and global context
+    bool multiplex;
+    bool persistent;
+    bool pool;
+    bool threaded;
     bool transaction;
     CURLM *multi;
+    CURLSH *share;
     HTAB *hash;
+    int deferred_timeout;
+    int max_concurrent_streams;
+    int max_header_bytes;
+    int max_host_connections;
+    int max_response_bytes;
+    int max_total_connections;
+    int maxconnects;
+    int retry_after_max;
+    int transfers; // handles in multi or in easy perform, resolver threads run only for them
+    List *done; // finished handles read by a loop that did not own them, kept for curl_multi_info_read
+    List *pending;
+    List *rejected; // retries completed by open circuit breaker, read by the next loop before libcurl messages
+    long share_data;
     MemoryContext context;
+    MemoryContext global;
+    pairingheap retry; // handles waiting for next try or rate limit token, earliest first
+    pg_curl_t *current; // handle being completed or re-added, so that the worker fails only it on error
     pthread_mutex_t mutex;
+    struct {
+        int64 header;
+        int64 response;
+    } aborted;
+    struct {
+        int64 allocations;
+        int64 frees;
+        int64 reallocations;
+    } memory;
 } pg_curl = {
     .mutex = PTHREAD_MUTEX_INITIALIZER,
+#if CURL_AT_LEAST_VERSION(7, 10, 3)
+    .share_data = (1L << CURL_LOCK_DATA_DNS) | (1L << CURL_LOCK_DATA_SSL_SESSION),
+#else
+    .share_data = 1L << CURL_LOCK_DATA_DNS,
+#endif
+    .deferred_timeout = 10000,
+    .max_concurrent_streams = 100,
+    .multiplex = true,
+    .retry_after_max = 60000,
+    .threaded = true,
     .transaction = true,
 };
 
+#if PG_VERSION_NUM >= 100000
+typedef struct {
+    curl_socket_t fd;
+    int pos;
+    int what;
+} pg_curl_socket_t;
+
+static struct {
+    bool dirty;
+    List *list;
+    TimestampTz deadline;
+    WaitEventSet *set;
+} pg_curl_socket;
+#endif
+
+#define PG_CURL_ERRCODE_BREAKER MAKE_SQLSTATE('X','B','0','0','0')
+#define PG_CURL_ERRCODE_LIMIT MAKE_SQLSTATE('X','L','0','0','0')
+
 static int pg_curl_ec(CURLcode ec) {
     if (ec < 10) return errcode(MAKE_SQLSTATE('X','E','0','0','0'+ec));
     if (ec < 100) return errcode(MAKE_SQLSTATE('X','E','0','0'+ec/10,'0'+ec%10));
@@ -70,85 +230,202 @@ static int pg_curl_mc(CURLMcode mc) {
     return errcode(MAKE_SQLSTATE('X','M','0','0','0'));
 }
 
+static int pg_curl_sc(CURLSHcode sc) {
+    if (sc < 10) return errcode(MAKE_SQLSTATE('X','S','0','0','0'+sc));
+    if (sc < 100) return errcode(MAKE_SQLSTATE('X','S','0','0'+sc/10,'0'+sc%10));
+    if (sc < 1000) return errcode(MAKE_SQLSTATE('X','S','0'+sc/100,'0'+(sc%100)/10,'0'+(sc%100)%10));
+    return errcode(MAKE_SQLSTATE('X','S','0','0','0'));
+}
+
+static bool pg_curl_locking(void) { // evaluated once per call, because backend may change it while resolver thread holds mutex
+    return pg_curl.threaded && (pg_curl.transfers || pg_curl.detached);
+}
+
 #if CURL_AT_LEAST_VERSION(7, 12, 0)
 static void *pg_curl_malloc_callback(size_t size) {
+    bool locking = pg_curl_locking();
     void *result;
-    pthread_mutex_lock(&pg_curl.mutex);
-    PG_TRY(); {
-        result = size ? MemoryContextAlloc(pg_curl.context, size) : NULL;
-    } PG_CATCH(); {
-        pthread_mutex_unlock(&pg_curl.mutex);
-        PG_RE_THROW();
-    } PG_END_TRY();
-    pthread_mutex_unlock(&pg_curl.mutex);
+    if (locking) pthread_mutex_lock(&pg_curl.mutex);
+    result = size ? MemoryContextAllocExtended(pg_curl.global, size, MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM) : NULL;
+    if (result) pg_curl.memory.allocations++;
+    if (locking) pthread_mutex_unlock(&pg_curl.mutex);
     return result;
 }
 
 static void pg_curl_free_callback(void *ptr) {
-    pthread_mutex_lock(&pg_curl.mutex);
-    PG_TRY(); {
-        if (ptr) pfree(ptr);
-    } PG_CATCH(); {
-        pthread_mutex_unlock(&pg_curl.mutex);
-        PG_RE_THROW();
-    } PG_END_TRY();
-    pthread_mutex_unlock(&pg_curl.mutex);
+    bool locking;
+    if (!ptr) return;
+    if ((locking = pg_curl_locking())) pthread_mutex_lock(&pg_curl.mutex);
+    pfree(ptr);
+    pg_curl.memory.frees++;
+    if (locking) pthread_mutex_unlock(&pg_curl.mutex);
 }
 
 static void *pg_curl_realloc_callback(void *ptr, size_t size) {
+    bool locking;
     void *result;
-    pthread_mutex_lock(&pg_curl.mutex);
+    if (!ptr) return pg_curl_malloc_callback(size);
+    if (!size) return ptr;
+    if ((locking = pg_curl_locking())) pthread_mutex_lock(&pg_curl.mutex);
+#if PG_VERSION_NUM >= 160000
+    result = repalloc_extended(ptr, size, MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM);
+#else
     PG_TRY(); {
-        result = (ptr && size) ? repalloc(ptr, size) : (size ? MemoryContextAlloc(pg_curl.context, size) : ptr);
+        result = repalloc_huge(ptr, size);
     } PG_CATCH(); {
-        pthread_mutex_unlock(&pg_curl.mutex);
+        if (locking) pthread_mutex_unlock(&pg_curl.mutex);
         PG_RE_THROW();
     } PG_END_TRY();
-    pthread_mutex_unlock(&pg_curl.mutex);
+#endif
+    if (result) pg_curl.memory.reallocations++;
+    if (locking) pthread_mutex_unlock(&pg_curl.mutex);
     return result;
 }
 
 static char *pg_curl_strdup_callback(const char *str) {
-    char *result;
-    pthread_mutex_lock(&pg_curl.mutex);
-    PG_TRY(); {
-        result = MemoryContextStrdup(pg_curl.context, str);
-    } PG_CATCH(); {
-        pthread_mutex_unlock(&pg_curl.mutex);
-        PG_RE_THROW();
-    } PG_END_TRY();
-    pthread_mutex_unlock(&pg_curl.mutex);
+    size_t size = strlen(str) + 1;
+    char *result = pg_curl_malloc_callback(size);
+    if (result) memcpy(result, str, size);
     return result;
 }
 
 static void *pg_curl_calloc_callback(size_t nmemb, size_t size) {
+    bool locking = pg_curl_locking();
     void *result;
-    pthread_mutex_lock(&pg_curl.mutex);
-    PG_TRY(); {
-        result = MemoryContextAllocZero(pg_curl.context, nmemb * size);
-    } PG_CATCH(); {
-        pthread_mutex_unlock(&pg_curl.mutex);
-        PG_RE_THROW();
-    } PG_END_TRY();
-    pthread_mutex_unlock(&pg_curl.mutex);
+    if (locking) pthread_mutex_lock(&pg_curl.mutex);
+    result = nmemb * size ? MemoryContextAllocExtended(pg_curl.global, nmemb * size, MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM | MCXT_ALLOC_ZERO) : NULL;
+    if (result) pg_curl.memory.allocations++;
+    if (locking) pthread_mutex_unlock(&pg_curl.mutex);
     return result;
 }
 #endif
 
+#if PG_VERSION_NUM >= 90500
+static void pg_curl_multi_cleanup(void *arg) {
+    if (!pg_curl.multi) return;
+    curl_multi_cleanup(pg_curl.multi);
+    pg_curl.multi = NULL;
+#if PG_VERSION_NUM >= 100000
+    if (pg_curl_socket.set) FreeWaitEventSet(pg_curl_socket.set);
+    list_free_deep(pg_curl_socket.list);
+    pg_curl_socket.deadline = 0;
+    pg_curl_socket.dirty = false;
+    pg_curl_socket.list = NIL;
+    pg_curl_socket.set = NULL;
+#endif
+}
+#endif
+
+#if PG_VERSION_NUM >= 90500
+static void pg_curl_share_cleanup_my(void *arg) { // handles of the context are cleaned up before, so share is in use only by a handle outliving it
+    CURLSHcode sc;
+    if (!pg_curl.share) return;
+    if ((sc = curl_share_cleanup(pg_curl.share)) != CURLSHE_OK) ereport(WARNING, (pg_curl_sc(sc), errmsg("%s", curl_share_strerror(sc))));
+    pg_curl.share = NULL;
+}
+#endif
+
 #if PG_VERSION_NUM >= 90500
 static void pg_curl_global_cleanup(void *arg) {
+    if (pg_curl.persistent && !pg_curl.pool) { // pool was turned off, so drop what it kept
+        pg_curl_multi_cleanup(NULL);
+        pg_curl_share_cleanup_my(NULL);
+        pg_curl.persistent = false;
+    }
+    if (!pg_curl.persistent && !pg_curl.detached) { // detached resolver thread frees into global context when it finishes
 #if CURL_AT_LEAST_VERSION(7, 8, 0)
-    curl_global_cleanup();
+        curl_global_cleanup();
 #endif
+        MemoryContextDelete(pg_curl.global);
+        pg_curl.global = NULL;
+    }
     pg_curl.context = NULL;
     pg_curl.hash = NULL;
 }
 #endif
 
+static LocalTransactionId pg_curl_lxid(void) {
+#if PG_VERSION_NUM >= 170000
+    return MyProc->vxid.lxid;
+#else
+    return MyProc->lxid;
+#endif
+}
+
+static void pg_curl_easy_sink_close(pg_curl_t *curl, bool raise_error) {
+    if (curl->sink.lxid != pg_curl_lxid()) { // closed by end of transaction
+        curl->sink.buffile = NULL;
+        curl->sink.file = NULL;
+        curl->sink.lo = NULL;
+        return;
+    }
+    if (curl->sink.file) {
+        FILE *file = curl->sink.file;
+        curl->sink.file = NULL;
+        if (FreeFile(file) && raise_error) ereport(ERROR, (errcode_for_file_access(), errmsg("could not close file \"%s\": %m", curl->sink.path)));
+    }
+    if (curl->sink.lo) {
+        LargeObjectDesc *lo = curl->sink.lo;
+        curl->sink.lo = NULL;
+        inv_close(lo);
+    }
+}
+
+static void pg_curl_easy_sink_file_check(void) {
+#if PG_VERSION_NUM >= 110000
+    if (!has_privs_of_role(GetUserId(), ROLE_PG_WRITE_SERVER_FILES)) ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE), errmsg("must be superuser or a member of the pg_write_server_files role to write files")));
+#else
+    if (!superuser()) ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE), errmsg("must be superuser to write files")));
+#endif
+}
+
+static void pg_curl_easy_sink_open(pg_curl_t *curl) {
+    MemoryContext oldMemoryContext;
+    pg_curl_easy_sink_close(curl, true);
+    if (curl->sink.buffile) BufFileClose(curl->sink.buffile);
+    curl->sink.buffile = NULL;
+    curl->sink.lxid = pg_curl_lxid();
+    switch (curl->sink.kind) {
+        case 'f':
+            pg_curl_easy_sink_file_check(); // current user may differ from the one who set the path
+            if (!(curl->sink.file = AllocateFile(curl->sink.path, PG_BINARY_W))) ereport(ERROR, (errcode_for_file_access(), errmsg("could not open file \"%s\" for writing: %m", curl->sink.path)));
+            break;
+        case 'l':
+            curl->sink.lo = inv_open(curl->sink.loid, INV_WRITE, TopTransactionContext);
+            inv_truncate(curl->sink.lo, 0);
+            break;
+        case 't':
+            oldMemoryContext = MemoryContextSwitchTo(TopTransactionContext);
+            curl->sink.buffile = BufFileCreateTemp(false);
+            MemoryContextSwitchTo(oldMemoryContext);
+            break;
+        default: break;
+    }
+}
+
+static void pg_curl_transfer_done(pg_curl_t *curl) {
+    double namelookup = 0;
+    if (pg_curl.threaded && curl_easy_getinfo(curl->easy, CURLINFO_NAMELOOKUP_TIME, &namelookup) == CURLE_OK && namelookup <= 0) pg_curl.detached = true; // stopped before name was resolved, so resolver thread may be detached
+    pg_curl.transfers--;
+}
+
 static void pg_curl_multi_remove_handle(pg_curl_t *curl, bool raise_error) {
+    CURLcode ec;
     CURLMcode mc;
-    if (curl->multi && (mc = curl_multi_remove_handle(curl->multi, curl->easy)) != CURLM_OK && raise_error) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
+    if (pg_curl.done) pg_curl.done = list_delete_ptr(pg_curl.done, curl);
+    if (pg_curl.rejected) pg_curl.rejected = list_delete_ptr(pg_curl.rejected, curl);
+    if (curl->waiting) {
+        pairingheap_remove(&pg_curl.retry, &curl->retry);
+        curl->reserved = false;
+        curl->waiting = false;
+    }
+    if (!curl->multi) return;
+    mc = curl_multi_remove_handle(curl->multi, curl->easy);
     curl->multi = NULL;
+    pg_curl_transfer_done(curl);
+    if (mc != CURLM_OK && raise_error) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_SHARE, NULL)) != CURLE_OK && raise_error) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    pg_curl_easy_sink_close(curl, raise_error);
 }
 
 #if PG_VERSION_NUM >= 90500
@@ -168,6 +445,7 @@ static void pg_curl_easy_cleanup(void *arg) {
         pg_curl_multi_remove_handle(curl, false);
         curl_easy_cleanup(curl->easy);
     }
+    if (curl->error) FreeErrorData(curl->error);
     pfree(curl);
 }
 #endif
@@ -186,12 +464,21 @@ static void pg_curl_global_init(void) {
     callback = MemoryContextAlloc(pg_curl.context, sizeof(*callback));
     callback->func = pg_curl_global_cleanup;
     MemoryContextRegisterResetCallback(pg_curl.context, callback);
+#endif
+    if (!pg_curl.global) {
+        pg_curl.persistent = pg_curl.pool && pg_curl.context != TopMemoryContext;
+#if PG_VERSION_NUM >= 90600
+        pg_curl.global = AllocSetContextCreate(TopMemoryContext, "pg_curl", ALLOCSET_DEFAULT_SIZES);
+#else
+        pg_curl.global = AllocSetContextCreate(TopMemoryContext, "pg_curl", ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
 #endif
 #if CURL_AT_LEAST_VERSION(7, 12, 0)
-    if (curl_global_init_mem(CURL_GLOBAL_ALL, pg_curl_malloc_callback, pg_curl_free_callback, pg_curl_realloc_callback, pg_curl_strdup_callback, pg_curl_calloc_callback)) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("curl_global_init_mem")));
+        if (curl_global_init_mem(CURL_GLOBAL_ALL, pg_curl_malloc_callback, pg_curl_free_callback, pg_curl_realloc_callback, pg_curl_strdup_callback, pg_curl_calloc_callback)) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("curl_global_init_mem")));
+        pg_curl.threaded = (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_ASYNCHDNS) && !curl_version_info(CURLVERSION_NOW)->ares; // only threaded resolver allocates outside of backend thread
 #elif CURL_AT_LEAST_VERSION(7, 8, 0)
-    if (curl_global_init(CURL_GLOBAL_ALL)) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("curl_global_init")));
+        if (curl_global_init(CURL_GLOBAL_ALL)) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("curl_global_init")));
 #endif
+    }
 #if PG_VERSION_NUM >= 140000
     pg_curl.hash = hash_create("Connection name hash", 1, &(HASHCTL){.keysize = NAMEDATALEN, .entrysize = sizeof(pg_curl_hash_t), .hcxt = pg_curl.context}, HASH_CONTEXT | HASH_ELEM | HASH_STRINGS);
 #else
@@ -199,14 +486,74 @@ static void pg_curl_global_init(void) {
 #endif
 }
 
-#if PG_VERSION_NUM >= 90500
-static void pg_curl_multi_cleanup(void *arg) {
-    if (!pg_curl.multi) return;
-    curl_multi_cleanup(pg_curl.multi);
-    pg_curl.multi = NULL;
+#if PG_VERSION_NUM >= 100000
+static uint32 pg_curl_socket_events(int what) {
+    uint32 events = 0;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) events |= WL_SOCKET_READABLE;
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) events |= WL_SOCKET_WRITEABLE;
+    return events;
+}
+
+static int pg_curl_socket_callback(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+    pg_curl_socket_t *sock = socketp;
+    if (what == CURL_POLL_REMOVE) {
+        if (!sock) return 0;
+        pg_curl_socket.list = list_delete_ptr(pg_curl_socket.list, sock);
+        pfree(sock);
+        pg_curl_socket.dirty = true;
+        return 0;
+    }
+    if (!sock) {
+        MemoryContext oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+        sock = palloc0(sizeof(*sock));
+        sock->fd = s;
+        pg_curl_socket.list = lappend(pg_curl_socket.list, sock);
+        MemoryContextSwitchTo(oldMemoryContext);
+        curl_multi_assign(pg_curl.multi, s, sock);
+        pg_curl_socket.dirty = true;
+    } else if (!pg_curl_socket.dirty && sock->what != what) {
+        if (sock->pos >= 0 && pg_curl_socket_events(what)) ModifyWaitEvent(pg_curl_socket.set, sock->pos, pg_curl_socket_events(what), NULL);
+        else pg_curl_socket.dirty = true;
+    }
+    sock->what = what;
+    return 0;
+}
+
+static int pg_curl_timer_callback(CURLM *multi, long timeout_ms, void *userp) {
+    pg_curl_socket.deadline = timeout_ms < 0 ? 0 : TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout_ms);
+    return 0;
+}
+
+static void pg_curl_multi_socket_init(void) {
+    CURLMcode mc;
+    if ((mc = curl_multi_setopt(pg_curl.multi, CURLMOPT_SOCKETFUNCTION, pg_curl_socket_callback)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
+    if ((mc = curl_multi_setopt(pg_curl.multi, CURLMOPT_TIMERFUNCTION, pg_curl_timer_callback)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
 }
 #endif
 
+static void pg_curl_share_init(void) {
+#if PG_VERSION_NUM >= 90500
+    MemoryContextCallback *callback;
+#endif
+    CURLSHcode sc;
+    if (pg_curl.share) return;
+    pg_curl_global_init();
+#if PG_VERSION_NUM >= 90500
+    if (!pg_curl.persistent) {
+        callback = MemoryContextAlloc(pg_curl.context, sizeof(*callback));
+        callback->func = pg_curl_share_cleanup_my;
+        MemoryContextRegisterResetCallback(pg_curl.context, callback);
+    }
+#endif
+    if (!(pg_curl.share = curl_share_init())) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_share_init")));
+    for (curl_lock_data data = CURL_LOCK_DATA_COOKIE; data < CURL_LOCK_DATA_LAST; data++) if (pg_curl.share_data & (1L << data) && (sc = curl_share_setopt(pg_curl.share, CURLSHOPT_SHARE, data)) != CURLSHE_OK) ereport(ERROR, (pg_curl_sc(sc), errmsg("%s", curl_share_strerror(sc))));
+}
+
+static void pg_curl_multi_setopt_my(CURLMoption option, long parameter) {
+    CURLMcode mc;
+    if ((mc = curl_multi_setopt(pg_curl.multi, option, parameter)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
+}
+
 static void pg_curl_multi_init(void) {
 #if PG_VERSION_NUM >= 90500
     MemoryContextCallback *callback;
@@ -214,43 +561,101 @@ static void pg_curl_multi_init(void) {
     if (pg_curl.multi) return;
     pg_curl_global_init();
 #if PG_VERSION_NUM >= 90500
-    callback = MemoryContextAlloc(pg_curl.context, sizeof(*callback));
-    callback->func = pg_curl_multi_cleanup;
-    MemoryContextRegisterResetCallback(pg_curl.context, callback);
+    if (!pg_curl.persistent) {
+        callback = MemoryContextAlloc(pg_curl.context, sizeof(*callback));
+        callback->func = pg_curl_multi_cleanup;
+        MemoryContextRegisterResetCallback(pg_curl.context, callback);
+    }
 #endif
     if (!(pg_curl.multi = curl_multi_init())) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_multi_init")));
+#if PG_VERSION_NUM >= 100000
+    pg_curl_multi_socket_init();
+#endif
+#if CURL_AT_LEAST_VERSION(7, 16, 3)
+    if (pg_curl.maxconnects) pg_curl_multi_setopt_my(CURLMOPT_MAXCONNECTS, pg_curl.maxconnects); // otherwise libcurl sizes connection cache by added handles
+#endif
+#if CURL_AT_LEAST_VERSION(7, 30, 0)
+    pg_curl_multi_setopt_my(CURLMOPT_MAX_HOST_CONNECTIONS, pg_curl.max_host_connections);
+    pg_curl_multi_setopt_my(CURLMOPT_MAX_TOTAL_CONNECTIONS, pg_curl.max_total_connections);
+#endif
+#if CURL_AT_LEAST_VERSION(7, 43, 0)
+    pg_curl_multi_setopt_my(CURLMOPT_PIPELINING, pg_curl.multiplex ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#endif
+#if CURL_AT_LEAST_VERSION(7, 67, 0)
+    pg_curl_multi_setopt_my(CURLMOPT_MAX_CONCURRENT_STREAMS, pg_curl.max_concurrent_streams);
+#endif
+    pg_curl_share_init();
 }
 
-static pg_curl_t *pg_curl_easy_init(const char *conname) {
-    bool found;
+#define PG_CURL_VARLENA_DATA(buf) ((buf)->data + VARHDRSZ)
+#define PG_CURL_VARLENA_LEN(buf) ((buf)->len - VARHDRSZ)
+
+static void pg_curl_varlena_reset(StringInfo buf) { // reserve varlena header, so that buffer can be returned without copy
+    resetStringInfo(buf);
+    appendStringInfoSpaces(buf, VARHDRSZ);
+    buf->cursor = VARHDRSZ;
+}
+
+static Datum pg_curl_varlena(StringInfo buf) {
+    SET_VARSIZE(buf->data, buf->len);
+    return PointerGetDatum(buf->data);
+}
+
+static Datum pg_curl_varlena_copy(StringInfo buf) { // buffer is reused by next transfer of the handle, which may happen while result is still referenced
+    struct varlena *result = palloc(buf->len);
+    SET_VARSIZE(result, buf->len);
+    memcpy(VARDATA(result), PG_CURL_VARLENA_DATA(buf), PG_CURL_VARLENA_LEN(buf));
+    return PointerGetDatum(result);
+}
+
+static void pg_curl_easy_data_in_init(pg_curl_t *curl, MemoryContext context) {
+    MemoryContext oldMemoryContext;
+#if PG_VERSION_NUM >= 90600
+    curl->data_in_context = AllocSetContextCreate(context, "pg_curl data_in", ALLOCSET_SMALL_SIZES);
+#else
+    curl->data_in_context = AllocSetContextCreate(context, "pg_curl data_in", ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+#endif
+    oldMemoryContext = MemoryContextSwitchTo(curl->data_in_context);
+    initStringInfo(&curl->data_in);
+    MemoryContextSwitchTo(oldMemoryContext);
+    pg_curl_varlena_reset(&curl->data_in);
+}
+
+static void pg_curl_easy_init_my(pg_curl_t *curl, MemoryContext context) {
 #if PG_VERSION_NUM >= 90500
     MemoryContextCallback *callback;
 #endif
     MemoryContext oldMemoryContext;
-    pg_curl_t *curl;
-    pg_curl_hash_t *hash;
-    pg_curl_multi_init();
-    hash = hash_search(pg_curl.hash, conname, HASH_ENTER, &found);
-    if (!found) hash->curl = MemoryContextAllocZero(pg_curl.context, sizeof(*hash->curl));
-    curl = hash->curl;
-    if (curl->easy) return curl;
-    oldMemoryContext = MemoryContextSwitchTo(pg_curl.context);
-    initStringInfo(&curl->data_in);
+    pg_curl_easy_data_in_init(curl, context);
+    oldMemoryContext = MemoryContextSwitchTo(context);
     initStringInfo(&curl->data_out);
     initStringInfo(&curl->debug);
     initStringInfo(&curl->header_in);
+    pg_curl_varlena_reset(&curl->header_in);
     initStringInfo(&curl->header_out);
     initStringInfo(&curl->postfield);
     initStringInfo(&curl->readdata);
     initStringInfo(&curl->url);
     MemoryContextSwitchTo(oldMemoryContext);
 #if PG_VERSION_NUM >= 90500
-    callback = MemoryContextAlloc(pg_curl.context, sizeof(*callback));
+    callback = MemoryContextAlloc(context, sizeof(*callback));
     callback->arg = curl;
     callback->func = pg_curl_easy_cleanup;
-    MemoryContextRegisterResetCallback(pg_curl.context, callback);
+    MemoryContextRegisterResetCallback(context, callback);
 #endif
     if (!(curl->easy = curl_easy_init())) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_easy_init")));
+}
+
+static pg_curl_t *pg_curl_easy_init(const char *conname) {
+    bool found;
+    pg_curl_t *curl;
+    pg_curl_hash_t *hash;
+    pg_curl_multi_init();
+    hash = hash_search(pg_curl.hash, conname, HASH_ENTER, &found);
+    if (!found) hash->curl = MemoryContextAllocZero(pg_curl.context, sizeof(*hash->curl));
+    curl = hash->curl;
+    curl->conname = hash->conname;
+    if (!curl->easy) pg_curl_easy_init_my(curl, pg_curl.context);
     return curl;
 }
 
@@ -306,6 +711,13 @@ EXTENSION(pg_curl_easy_recipient_reset) {
 #endif
 }
 
+static void pg_curl_easy_readcursor_close(pg_curl_t *curl) {
+    Portal portal;
+    if (!curl->readcursor[0]) return;
+    if (IsTransactionState() && (portal = SPI_cursor_find(curl->readcursor))) SPI_cursor_close(portal);
+    curl->readcursor[0] = '\0';
+}
+
 EXTENSION(pg_curl_easy_reset) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
     curl->errbuf[0] = '\0';
@@ -323,15 +735,30 @@ EXTENSION(pg_curl_easy_reset) {
 #if CURL_AT_LEAST_VERSION(7, 12, 1)
     curl_easy_reset(curl->easy);
 #endif
-    resetStringInfo(&curl->data_in);
+    pg_curl_varlena_reset(&curl->data_in);
     resetStringInfo(&curl->data_out);
     resetStringInfo(&curl->debug);
-    resetStringInfo(&curl->header_in);
+    pg_curl_varlena_reset(&curl->header_in);
     resetStringInfo(&curl->header_out);
     resetStringInfo(&curl->postfield);
     resetStringInfo(&curl->readdata);
     resetStringInfo(&curl->url);
+    pg_curl_easy_readcursor_close(curl);
     pg_curl_multi_remove_handle(curl, true);
+    pg_curl_easy_sink_close(curl, true);
+    if (curl->sink.path) pfree(curl->sink.path);
+    curl->limit = NULL;
+    curl->max_header_bytes = 0;
+    curl->max_response_bytes = 0;
+    curl->sink.kind = '\0';
+    curl->sink.path = NULL;
+    curl->ws = false;
+    curl->backoff.jitter = 0;
+    curl->backoff.max = 0;
+    curl->backoff.multiplier = 0;
+    bms_free(curl->retry_http.status);
+    curl->retry_http.any_method = false;
+    curl->retry_http.status = NULL;
     PG_RETURN_BOOL(true);
 }
 
@@ -370,22 +797,28 @@ EXTENSION(pg_curl_easy_unescape) {
 #endif
 }
 
+static bool pg_curl_header_append_my(pg_curl_t *curl, const char *name, const char *value) {
+    StringInfoData buf;
+    struct curl_slist *temp = curl->header;
+    initStringInfo(&buf);
+    if (value) appendStringInfo(&buf, "%s: %s", name, value); else appendStringInfo(&buf, "%s:", name);
+    if ((temp = curl_slist_append(temp, buf.data))) curl->header = temp; else ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_slist_append")));
+    pfree(buf.data);
+    return temp != NULL;
+}
+
 EXTENSION(pg_curl_header_append) {
+    bool result;
     char *name, *value;
-    StringInfoData buf;
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(2));
-    struct curl_slist *temp = curl->header;
     if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_header_append requires argument name")));
     name = TextDatumGetCString(PG_GETARG_DATUM(0));
     if (PG_ARGISNULL(1)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_header_append requires argument value")));
     value = TextDatumGetCString(PG_GETARG_DATUM(1));
-    initStringInfo(&buf);
-    appendStringInfo(&buf, "%s: %s", name, value);
-    if ((temp = curl_slist_append(temp, buf.data))) curl->header = temp; else ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_slist_append")));
+    result = pg_curl_header_append_my(curl, name, value);
     pfree(name);
     pfree(value);
-    pfree(buf.data);
-    PG_RETURN_BOOL(temp != NULL);
+    PG_RETURN_BOOL(result);
 }
 
 EXTENSION(pg_curl_postquote_append) {
@@ -526,6 +959,7 @@ EXTENSION(pg_curl_easy_setopt_postfields) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
     if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_easy_setopt_postfields requires argument parameter")));
     parameter = PG_GETARG_BYTEA_PP(0);
+    pg_curl_easy_readcursor_close(curl);
     resetStringInfo(&curl->postfield);
     resetStringInfo(&curl->readdata);
     appendBinaryStringInfo(&curl->postfield, VARDATA_ANY(parameter), VARSIZE_ANY_EXHDR(parameter));
@@ -539,6 +973,7 @@ EXTENSION(pg_curl_easy_setopt_readdata) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
     if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_easy_setopt_readdata requires argument parameter")));
     parameter = PG_GETARG_BYTEA_PP(0);
+    pg_curl_easy_readcursor_close(curl);
     resetStringInfo(&curl->postfield);
     resetStringInfo(&curl->readdata);
     appendBinaryStringInfo(&curl->readdata, VARDATA_ANY(parameter), VARSIZE_ANY_EXHDR(parameter));
@@ -546,6 +981,113 @@ EXTENSION(pg_curl_easy_setopt_readdata) {
     PG_RETURN_BOOL(ec == CURLE_OK);
 }
 
+static Datum pg_curl_easy_setopt_limit(PG_FUNCTION_ARGS, int64 *limit, const char *name) {
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_easy_setopt_%s requires argument parameter", name)));
+    if ((*limit = PG_GETARG_INT64(0)) < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_easy_setopt_%s invalid argument parameter " INT64_FORMAT, name, *limit), errhint("Argument parameter must be non-negative!")));
+    PG_RETURN_BOOL(true);
+}
+
+EXTENSION(pg_curl_easy_setopt_max_header_bytes) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
+    return pg_curl_easy_setopt_limit(fcinfo, &curl->max_header_bytes, "max_header_bytes");
+}
+
+EXTENSION(pg_curl_easy_setopt_max_response_bytes) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
+    return pg_curl_easy_setopt_limit(fcinfo, &curl->max_response_bytes, "max_response_bytes");
+}
+
+EXTENSION(pg_curl_easy_setopt_backoff) {
+    double jitter, multiplier;
+    int64 max;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(3));
+    if ((multiplier = PG_ARGISNULL(0) ? 1 : PG_GETARG_FLOAT8(0)) < 1) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_easy_setopt_backoff invalid argument multiplier %g", multiplier), errhint("Argument multiplier must be at least 1!")));
+    if ((max = PG_ARGISNULL(1) ? 0 : PG_GETARG_INT64(1)) < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_easy_setopt_backoff invalid argument max " INT64_FORMAT, max), errhint("Argument max must be non-negative!")));
+    if ((jitter = PG_ARGISNULL(2) ? 0 : PG_GETARG_FLOAT8(2)) < 0 || jitter > 1) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_easy_setopt_backoff invalid argument jitter %g", jitter), errhint("Argument jitter must be between 0 and 1!")));
+    curl->backoff.jitter = jitter;
+    curl->backoff.max = max;
+    curl->backoff.multiplier = multiplier;
+    PG_RETURN_BOOL(true);
+}
+
+EXTENSION(pg_curl_easy_setopt_retry_status) {
+    bool any_method = !PG_ARGISNULL(1) && PG_GETARG_BOOL(1);
+    Bitmapset *status = NULL;
+    MemoryContext oldMemoryContext;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(2));
+    if (!PG_ARGISNULL(0)) {
+        ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+        bool *nulls;
+        Datum *elems;
+        int nelems;
+        if (ARR_NDIM(array) > 1) ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR), errmsg("curl_easy_setopt_retry_status requires one-dimensional array")));
+        deconstruct_array(array, INT4OID, sizeof(int32), true, 'i', &elems, &nulls, &nelems);
+        oldMemoryContext = MemoryContextSwitchTo(pg_curl.context);
+        for (int i = 0; i < nelems; i++) if (!nulls[i]) {
+            int32 code = DatumGetInt32(elems[i]);
+            if (code < 100 || code > 599) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_easy_setopt_retry_status invalid response code %i", code), errhint("Response code must be between 100 and 599!")));
+            status = bms_add_member(status, code);
+        }
+        MemoryContextSwitchTo(oldMemoryContext);
+    }
+    bms_free(curl->retry_http.status);
+    curl->retry_http.any_method = any_method;
+    curl->retry_http.status = status;
+    PG_RETURN_BOOL(true);
+}
+
+EXTENSION(pg_curl_easy_setopt_readquery) {
+    char *format = "csv";
+    char *query;
+    Portal portal;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(2));
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_easy_setopt_readquery requires argument query")));
+    query = TextDatumGetCString(PG_GETARG_DATUM(0));
+    if (!PG_ARGISNULL(1)) format = TextDatumGetCString(PG_GETARG_DATUM(1));
+    pg_curl_easy_readcursor_close(curl);
+    if (!pg_strcasecmp(format, "binary")) curl->readformat = 'b';
+    else if (!pg_strcasecmp(format, "csv")) curl->readformat = 'c';
+    else if (!pg_strcasecmp(format, "json")) curl->readformat = 'j';
+    else if (!pg_strcasecmp(format, "text")) curl->readformat = 't';
+    else ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("unsupported format \"%s\"", format), errhint("Use binary, csv, json or text.")));
+    SPI_connect();
+    if (!(portal = SPI_cursor_open_with_args(NULL, query, 0, NULL, NULL, NULL, false, 0))) ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("SPI_cursor_open_with_args failed: %s", SPI_result_code_string(SPI_result))));
+    strlcpy(curl->readcursor, portal->name, sizeof(curl->readcursor));
+    SPI_finish();
+    curl->readeof = false;
+    curl->readheader = false;
+    resetStringInfo(&curl->postfield);
+    resetStringInfo(&curl->readdata);
+    PG_RETURN_BOOL(true);
+}
+
+EXTENSION(pg_curl_easy_setopt_sink_file) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_easy_setopt_sink_file requires argument path")));
+    pg_curl_easy_sink_file_check();
+    if (curl->sink.path) pfree(curl->sink.path);
+    curl->sink.path = MemoryContextStrdup(pg_curl.context, TextDatumGetCString(PG_GETARG_DATUM(0)));
+    curl->sink.kind = 'f';
+    PG_RETURN_BOOL(true);
+}
+
+EXTENSION(pg_curl_easy_setopt_sink_lo) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_easy_setopt_sink_lo requires argument loid")));
+    curl->sink.loid = PG_GETARG_OID(0);
+#if PG_VERSION_NUM < 110000
+    if (!lo_compat_privileges && pg_largeobject_aclcheck_snapshot(curl->sink.loid, GetUserId(), ACL_UPDATE, NULL) != ACLCHECK_OK) ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE), errmsg("permission denied for large object %u", curl->sink.loid)));
+#endif
+    curl->sink.kind = 'l';
+    PG_RETURN_BOOL(true);
+}
+
+EXTENSION(pg_curl_easy_setopt_sink_tempfile) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    curl->sink.kind = 't';
+    PG_RETURN_BOOL(true);
+}
+
 EXTENSION(pg_curl_easy_setopt_url) {
     CURLcode ec = CURLE_OK;
     text *parameter;
@@ -581,6 +1123,7 @@ static Datum pg_curl_postfield_or_url_append(PG_FUNCTION_ARGS, pg_curl_t *curl,
 EXTENSION(pg_curl_postfield_append) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(2));
     if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("pg_curl_postfield_append requires argument name")));
+    pg_curl_easy_readcursor_close(curl);
     resetStringInfo(&curl->readdata);
     return pg_curl_postfield_or_url_append(fcinfo, curl, &curl->postfield);
 }
@@ -1744,42 +2287,212 @@ EXTENSION(pg_curl_easy_setopt_wildcardmatch) {
 static int pg_progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) { return QueryCancelPending || ProcDiePending; }
 #endif
 
+static void pg_curl_callback_error(pg_curl_t *curl, MemoryContext context) { // longjmp out of libcurl would corrupt it, so keep error until libcurl returned
+    ErrorData *error;
+    MemoryContextSwitchTo(pg_curl.context);
+    error = CopyErrorData();
+    FlushErrorState();
+    MemoryContextSwitchTo(context);
+    if (curl->error) FreeErrorData(error); else curl->error = error;
+}
+
+static void pg_curl_callback_rethrow(pg_curl_t *curl) {
+    ErrorData *error = curl->error;
+    if (!error) return;
+    curl->error = NULL;
+    ReThrowError(error);
+}
+
+static size_t pg_curl_easy_limit(pg_curl_t *curl, bool header) {
+    curl->limit = header ? "max_header_bytes" : "max_response_bytes";
+    if (header) pg_curl.aborted.header++; else pg_curl.aborted.response++;
+    return 0;
+}
+
 static size_t pg_header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
     pg_curl_t *curl = userdata;
+    int64 max = curl->max_header_bytes ? curl->max_header_bytes : pg_curl.max_header_bytes;
     size *= nitems;
+    if (max && PG_CURL_VARLENA_LEN(&curl->header_in) + (int64)size > max) return pg_curl_easy_limit(curl, true);
     if (size) appendBinaryStringInfo(&curl->header_in, buffer, size);
     return size;
 }
 
+#define PG_CURL_READCURSOR_FETCH 1000
+
+static void pg_curl_readcursor_int16(StringInfo buf, int16 value) {
+    uint16 n = htons((uint16)value);
+    appendBinaryStringInfo(buf, (char *)&n, sizeof(n));
+}
+
+static void pg_curl_readcursor_int32(StringInfo buf, int32 value) {
+    uint32 n = htonl((uint32)value);
+    appendBinaryStringInfo(buf, (char *)&n, sizeof(n));
+}
+
+static void pg_curl_readcursor_csv(StringInfo buf, const char *value) {
+    if (*value && !strpbrk(value, ",\"\n\r")) { appendStringInfoString(buf, value); return; }
+    appendStringInfoChar(buf, '"');
+    for (; *value; value++) {
+        if (*value == '"') appendStringInfoChar(buf, '"');
+        appendStringInfoChar(buf, *value);
+    }
+    appendStringInfoChar(buf, '"');
+}
+
+static void pg_curl_readcursor_text(StringInfo buf, const char *value) {
+    for (; *value; value++) switch (*value) {
+        case '\\': appendStringInfoString(buf, "\\\\"); break;
+        case '\b': appendStringInfoString(buf, "\\b"); break;
+        case '\f': appendStringInfoString(buf, "\\f"); break;
+        case '\n': appendStringInfoString(buf, "\\n"); break;
+        case '\r': appendStringInfoString(buf, "\\r"); break;
+        case '\t': appendStringInfoString(buf, "\\t"); break;
+        case '\v': appendStringInfoString(buf, "\\v"); break;
+        default: appendStringInfoChar(buf, *value); break;
+    }
+}
+
+static void pg_curl_readcursor_row(pg_curl_t *curl, HeapTuple tuple, TupleDesc tupdesc) {
+    StringInfo buf = &curl->readdata;
+    if (curl->readformat == 'j') { // cursor runs the query as given, so that it may end with semicolon
+        appendStringInfoString(buf, TextDatumGetCString(DirectFunctionCall1(row_to_json, heap_copy_tuple_as_datum(tuple, BlessTupleDesc(tupdesc)))));
+        appendStringInfoChar(buf, '\n');
+        return;
+    }
+    if (curl->readformat == 'b') pg_curl_readcursor_int16(buf, tupdesc->natts);
+    for (int i = 1; i <= tupdesc->natts; i++) {
+        bool isnull;
+        Datum value = SPI_getbinval(tuple, tupdesc, i, &isnull);
+        if (curl->readformat == 'b') {
+            bool isvarlena;
+            bytea *send;
+            Oid func;
+            if (isnull) { pg_curl_readcursor_int32(buf, -1); continue; }
+            getTypeBinaryOutputInfo(SPI_gettypeid(tupdesc, i), &func, &isvarlena);
+            send = OidSendFunctionCall(func, value);
+            pg_curl_readcursor_int32(buf, VARSIZE(send) - VARHDRSZ);
+            appendBinaryStringInfo(buf, VARDATA(send), VARSIZE(send) - VARHDRSZ);
+            continue;
+        }
+        if (i > 1) appendStringInfoChar(buf, curl->readformat == 'c' ? ',' : '\t');
+        if (isnull) { if (curl->readformat != 'c') appendStringInfoString(buf, "\\N"); continue; }
+        switch (curl->readformat) {
+            case 'c': pg_curl_readcursor_csv(buf, SPI_getvalue(tuple, tupdesc, i)); break;
+            default: pg_curl_readcursor_text(buf, SPI_getvalue(tuple, tupdesc, i)); break;
+        }
+    }
+    if (curl->readformat != 'b') appendStringInfoChar(buf, '\n');
+}
+
+static void pg_curl_readcursor_fetch(pg_curl_t *curl) {
+    Portal portal;
+    StringInfo buf = &curl->readdata;
+    resetStringInfo(buf);
+    if (curl->readeof) return;
+    if (!(portal = SPI_cursor_find(curl->readcursor))) ereport(ERROR, (errcode(ERRCODE_UNDEFINED_CURSOR), errmsg("cursor \"%s\" does not exist", curl->readcursor), errhint("Call curl_easy_setopt_readquery in the same transaction.")));
+    SPI_connect();
+    SPI_cursor_fetch(portal, true, PG_CURL_READCURSOR_FETCH);
+    if (curl->readformat == 'b' && !curl->readheader) {
+        appendBinaryStringInfo(buf, "PGCOPY\n\377\r\n\0", 11);
+        pg_curl_readcursor_int32(buf, 0);
+        pg_curl_readcursor_int32(buf, 0);
+        curl->readheader = true;
+    }
+    for (uint64 row = 0; row < SPI_processed; row++) pg_curl_readcursor_row(curl, SPI_tuptable->vals[row], SPI_tuptable->tupdesc);
+    if (!SPI_processed) {
+        if (curl->readformat == 'b') pg_curl_readcursor_int16(buf, -1);
+        curl->readeof = true;
+    }
+    SPI_finish();
+}
+
 static size_t pg_read_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
     pg_curl_t *curl = userdata;
     size_t reqsize = size * nitems;
     StringInfoData *si = &curl->readdata;
-    size_t remaining = si->len - si->cursor;
-    size_t readsize = reqsize < remaining ? reqsize : remaining;
+    size_t remaining, readsize;
+    if (curl->readcursor[0] && si->cursor >= si->len) {
+        bool failed = false;
+        MemoryContext oldMemoryContext = CurrentMemoryContext;
+        PG_TRY(); {
+            pg_curl_readcursor_fetch(curl);
+        } PG_CATCH(); {
+            pg_curl_callback_error(curl, oldMemoryContext);
+            failed = true;
+        } PG_END_TRY();
+        if (failed) return CURL_READFUNC_ABORT;
+    }
+    remaining = si->len - si->cursor;
+    readsize = reqsize < remaining ? reqsize : remaining;
     memcpy(buffer, si->data + si->cursor, readsize);
     si->cursor += readsize;
     return readsize;
 }
 
+static curl_off_t pg_curl_easy_content_length(pg_curl_t *curl) {
+#if CURL_AT_LEAST_VERSION(7, 55, 0)
+    curl_off_t length;
+    if (curl_easy_getinfo(curl->easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) != CURLE_OK) return -1;
+    return length;
+#else
+    double length;
+    if (curl_easy_getinfo(curl->easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length) != CURLE_OK) return -1;
+    return (curl_off_t)length;
+#endif
+}
+
+#define PG_CURL_CONTENT_LENGTH_MAX (8 * 1024 * 1024) // preallocate at most this for a length announced by server, unless max_response_bytes allows more
+
 static size_t pg_write_callback(char *ptr, size_t size, size_t nmemb, void *userdata) {
     pg_curl_t *curl = userdata;
+    int64 max = curl->max_response_bytes ? curl->max_response_bytes : pg_curl.max_response_bytes;
     size *= nmemb;
-    if (size) appendBinaryStringInfo(&curl->data_in, ptr, size);
+    if (!size) return size;
+    if (!curl->received) { // first chunk, size of body is known now if server sent it
+        curl_off_t length = pg_curl_easy_content_length(curl);
+        if (max && length > max) return pg_curl_easy_limit(curl, false);
+        if (!max && length > PG_CURL_CONTENT_LENGTH_MAX) length = PG_CURL_CONTENT_LENGTH_MAX;
+        if (!curl->sink.kind && length > 0 && length < (curl_off_t)(MaxAllocSize - curl->data_in.len - 1)) enlargeStringInfo(&curl->data_in, length);
+    }
+    if (max && curl->received + (int64)size > max) return pg_curl_easy_limit(curl, false);
+    curl->received += size;
+    switch (curl->sink.kind) {
+        case 'f': return fwrite(ptr, 1, size, curl->sink.file);
+        case 'l': case 't': {
+            bool failed = false;
+            MemoryContext oldMemoryContext = CurrentMemoryContext;
+            PG_TRY(); {
+                if (curl->sink.kind == 'l') size = inv_write(curl->sink.lo, ptr, size);
+                else BufFileWrite(curl->sink.buffile, ptr, size);
+            } PG_CATCH(); {
+                pg_curl_callback_error(curl, oldMemoryContext);
+                failed = true;
+            } PG_END_TRY();
+            if (failed) return 0;
+        } break;
+        default: appendBinaryStringInfo(&curl->data_in, ptr, size); break;
+    }
     return size;
 }
 
 static CURLcode pg_curl_easy_prepare(pg_curl_t *curl) {
+    if (curl->error) FreeErrorData(curl->error);
+    curl->error = NULL;
     curl->errcode = CURL_LAST;
-    resetStringInfo(&curl->data_in);
+    curl->limit = NULL;
+    curl->received = 0;
+    curl->rejected = false;
+    pg_curl_easy_sink_open(curl);
+    pg_curl_varlena_reset(&curl->data_in);
     resetStringInfo(&curl->data_out);
     resetStringInfo(&curl->debug);
-    resetStringInfo(&curl->header_in);
+    pg_curl_varlena_reset(&curl->header_in);
     resetStringInfo(&curl->header_out);
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_ERRORBUFFER, curl->errbuf)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_HEADERDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_HEADERFUNCTION, pg_header_callback)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
-    if (curl->header && ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_HTTPHEADER, curl->header)) != CURLE_OK)) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_HTTPHEADER, curl->header)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if (curl->postquote && ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_POSTQUOTE, curl->postquote)) != CURLE_OK)) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if (curl->prequote && ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_PREQUOTE, curl->prequote)) != CURLE_OK)) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if (curl->quote && ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_QUOTE, curl->quote)) != CURLE_OK)) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
@@ -1793,10 +2506,12 @@ static CURLcode pg_curl_easy_prepare(pg_curl_t *curl) {
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_NOSIGNAL, 1L)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if (curl->postfield.len && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_POSTFIELDS, curl->postfield.data)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if (curl->postfield.len && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_POSTFIELDSIZE_LARGE, curl->postfield.len)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
-    if (curl->readdata.len && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_INFILESIZE_LARGE, curl->readdata.len)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
-    if (curl->readdata.len && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_READDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
-    if (curl->readdata.len && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_READFUNCTION, pg_read_callback)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
-    if (curl->readdata.len && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_UPLOAD, 1L)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if (curl->readcursor[0] && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_INFILESIZE_LARGE, (curl_off_t)-1)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if (!curl->readcursor[0]) curl->readdata.cursor = 0; // rewind for retries
+    if (!curl->readcursor[0] && curl->readdata.len && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_INFILESIZE_LARGE, curl->readdata.len)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if ((curl->readcursor[0] || curl->readdata.len) && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_READDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if ((curl->readcursor[0] || curl->readdata.len) && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_READFUNCTION, pg_read_callback)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if ((curl->readcursor[0] || curl->readdata.len) && (curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_UPLOAD, 1L)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_URL, curl->url.data)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_WRITEDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_WRITEFUNCTION, pg_write_callback)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
@@ -1805,73 +2520,2538 @@ static CURLcode pg_curl_easy_prepare(pg_curl_t *curl) {
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_XFERINFOFUNCTION, pg_progress_callback)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
 #endif
     if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_PRIVATE, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    pg_curl_share_init();
+    if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_SHARE, pg_curl.share)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     curl->try = 0;
     return curl->errcode;
 }
 
-static bool pg_curl_multi_add_handle_my(const char *conname) {
-    CURLMcode mc;
-    pg_curl_t *curl = pg_curl_easy_init(conname);
-    pg_curl_multi_remove_handle(curl, true);
-    if ((curl->errcode = pg_curl_easy_prepare(curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
-    if ((mc = curl_multi_add_handle(curl->multi = pg_curl.multi, curl->easy)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
-    return curl->errcode == CURLE_OK && mc == CURLM_OK;
-}
+#if PG_VERSION_NUM >= 100000
+#define PG_CURL_LIMIT_HOST 256
 
-EXTENSION(pg_curl_multi_add_handle) {
-    PG_RETURN_BOOL(pg_curl_multi_add_handle_my(PG_CONNAME(0)));
-}
+typedef struct {
+    char host[PG_CURL_LIMIT_HOST];
+    double burst;
+    double rate;
+} pg_curl_limit_rule_t;
 
-EXTENSION(pg_curl_multi_perform) {
-    CURLcode ec = CURL_LAST;
-    CURLMcode mc;
-    CURLMsg *msg;
-    int msgs_in_queue;
-    int running_handles;
-    int timeout_ms;
-    int try;
-    long sleep;
-    if ((try = PG_ARGISNULL(0) ? 1 : PG_GETARG_INT32(0)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_perform invalid argument try %i", try), errhint("Argument try must be positive!")));
-    if ((sleep = PG_ARGISNULL(1) ? 1000000 : PG_GETARG_INT64(1)) < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_perform invalid argument sleep %li", sleep), errhint("Argument sleep must be non-negative!")));
-    if ((timeout_ms = PG_ARGISNULL(2) ? 1000 : PG_GETARG_INT32(0)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_perform invalid argument timeout_ms %i", timeout_ms), errhint("Argument timeout_ms must be positive!")));
+typedef struct {
+    int count;
+    pg_curl_limit_rule_t rule[FLEXIBLE_ARRAY_MEMBER];
+} pg_curl_limit_rules_t;
+
+typedef struct {
+    char host[PG_CURL_LIMIT_HOST]; // always first, because it is key for hashmap
+    double burst;
+    double rate;
+    double tokens; // negative while requests wait for their tokens
+    int64 delayed;
+    int64 granted;
+    TimestampTz updated;
+} pg_curl_limit_t;
+
+static struct {
+    char *config;
+    HTAB *hash;
+    int hosts;
+    LWLock *lock;
+    pg_curl_limit_rules_t *rules;
+} pg_curl_limit = {
+    .hosts = 64,
+};
+
+static bool pg_curl_limit_check(char **newval, void **extra, GucSource source) { // host=rate[/burst], ... where * matches other hosts
+    char *config = pstrdup(*newval);
+    char *next;
+    int count = 1;
+    pg_curl_limit_rules_t *rules;
+    for (char *c = config; *c; c++) if (*c == ',') count++;
+    if (!(rules = malloc(offsetof(pg_curl_limit_rules_t, rule) + count * sizeof(*rules->rule)))) {
+        GUC_check_errcode(ERRCODE_OUT_OF_MEMORY);
+        GUC_check_errmsg("out of memory");
+        pfree(config);
+        return false;
+    }
+    rules->count = 0;
+    for (char *item = config; item; item = next) {
+        char *end;
+        char *value;
+        pg_curl_limit_rule_t *rule = &rules->rule[rules->count];
+        if ((next = strchr(item, ','))) *next++ = '\0';
+        while (isspace((unsigned char)*item)) item++;
+        if (!*item) continue;
+        if (!(value = strchr(item, '='))) {
+            GUC_check_errdetail("Rule \"%s\" must look like host=rate[/burst].", item);
+            goto error;
+        }
+        for (end = value; end > item && isspace((unsigned char)end[-1]); end--);
+        *end = '\0';
+        if (!*item || strlen(item) >= PG_CURL_LIMIT_HOST) {
+            GUC_check_errdetail("Host \"%s\" must not be empty or longer than %i characters.", item, PG_CURL_LIMIT_HOST - 1);
+            goto error;
+        }
+        for (int i = 0; item[i]; i++) rule->host[i] = pg_tolower((unsigned char)item[i]);
+        rule->host[strlen(item)] = '\0';
+        rule->rate = strtod(++value, &end);
+        if (end == value || rule->rate <= 0) {
+            GUC_check_errdetail("Rate of host \"%s\" must be positive number of requests per second.", rule->host);
+            goto error;
+        }
+        rule->burst = Max(rule->rate, 1);
+        if (*end == '/') {
+            rule->burst = strtod(value = end + 1, &end);
+            if (end == value || rule->burst < 1) {
+                GUC_check_errdetail("Burst of host \"%s\" must be at least 1.", rule->host);
+                goto error;
+            }
+        }
+        while (isspace((unsigned char)*end)) end++;
+        if (*end) {
+            GUC_check_errdetail("Rule of host \"%s\" must look like host=rate[/burst].", rule->host);
+            goto error;
+        }
+        rules->count++;
+    }
+    pfree(config);
+    *extra = rules;
+    return true;
+error:
+    free(rules);
+    pfree(config);
+    return false;
+}
+
+static void pg_curl_limit_assign(const char *newval, void *extra) {
+    pg_curl_limit.rules = extra;
+}
+
+static Size pg_curl_limit_shmem_size(void) {
+    return hash_estimate_size(pg_curl_limit.hosts, sizeof(pg_curl_limit_t));
+}
+
+static void pg_curl_limit_shmem_startup(void) { // called under AddinShmemInitLock
+    pg_curl_limit.lock = &(GetNamedLWLockTranche("pg_curl limit"))->lock;
+#if PG_VERSION_NUM >= 140000
+    pg_curl_limit.hash = ShmemInitHash("pg_curl limit", pg_curl_limit.hosts, pg_curl_limit.hosts, &(HASHCTL){.keysize = PG_CURL_LIMIT_HOST, .entrysize = sizeof(pg_curl_limit_t)}, HASH_ELEM | HASH_STRINGS);
+#else
+    pg_curl_limit.hash = ShmemInitHash("pg_curl limit", pg_curl_limit.hosts, pg_curl_limit.hosts, &(HASHCTL){.keysize = PG_CURL_LIMIT_HOST, .entrysize = sizeof(pg_curl_limit_t)}, HASH_ELEM);
+#endif
+}
+
+static void pg_curl_easy_host(pg_curl_t *curl, char *host) { // lower case host of request url, empty when unknown
+    host[0] = '\0';
+#if CURL_AT_LEAST_VERSION(7, 62, 0)
+    {
+        char *part = NULL;
+        CURLU *url;
+        if (!(url = curl_url())) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_url")));
+        if (curl_url_set(url, CURLUPART_URL, curl->url.data, CURLU_DEFAULT_SCHEME | CURLU_NON_SUPPORT_SCHEME) == CURLUE_OK && curl_url_get(url, CURLUPART_HOST, &part, 0) == CURLUE_OK) strlcpy(host, part, PG_CURL_LIMIT_HOST);
+        curl_free(part);
+        curl_url_cleanup(url);
+    }
+#endif
+    for (char *c = host; *c; c++) *c = pg_tolower((unsigned char)*c);
+}
+
+static void pg_curl_limit_evict(TimestampTz now) { // full bucket is the same as a new one, so the longest idle of them makes room, called under exclusive lock
+    HASH_SEQ_STATUS status;
+    pg_curl_limit_t *limit;
+    pg_curl_limit_t *idle = NULL;
+    hash_seq_init(&status, pg_curl_limit.hash);
+    while ((limit = hash_seq_search(&status))) {
+        if (now <= limit->updated || limit->tokens + limit->rate * (now - limit->updated) / USECS_PER_SEC < limit->burst) continue;
+        if (!idle || limit->updated < idle->updated) idle = limit;
+    }
+    if (idle) hash_search(pg_curl_limit.hash, idle->host, HASH_REMOVE, NULL);
+}
+
+static long pg_curl_limit_acquire(pg_curl_t *curl) { // microseconds until the token of request host, tokens go negative so that waiting requests keep their order
+    char host[PG_CURL_LIMIT_HOST];
+    double tokens;
+    pg_curl_limit_rule_t *rule = NULL;
+    pg_curl_limit_t *limit;
+    TimestampTz now;
+    if (!pg_curl_limit.rules || !pg_curl_limit.rules->count) return 0;
+    pg_curl_easy_host(curl, host);
+    if (!host[0]) return 0;
+    for (int i = 0; i < pg_curl_limit.rules->count; i++) {
+        if (!strcmp(pg_curl_limit.rules->rule[i].host, host)) {
+            rule = &pg_curl_limit.rules->rule[i];
+            break;
+        }
+        if (!rule && !strcmp(pg_curl_limit.rules->rule[i].host, "*")) rule = &pg_curl_limit.rules->rule[i];
+    }
+    if (!rule) return 0;
+    if (!pg_curl_limit.hash) ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE), errmsg("pg_curl rate limit is not available"), errhint("Add pg_curl to shared_preload_libraries.")));
+    now = GetCurrentTimestamp();
+    LWLockAcquire(pg_curl_limit.lock, LW_EXCLUSIVE);
+    if (!(limit = hash_search(pg_curl_limit.hash, host, HASH_FIND, NULL))) {
+        if (hash_get_num_entries(pg_curl_limit.hash) >= pg_curl_limit.hosts) pg_curl_limit_evict(now);
+        if (hash_get_num_entries(pg_curl_limit.hash) >= pg_curl_limit.hosts || !(limit = hash_search(pg_curl_limit.hash, host, HASH_ENTER_NULL, NULL))) { // every bucket is in use, so host goes unlimited rather than failing the request
+            LWLockRelease(pg_curl_limit.lock);
+            return 0;
+        }
+        limit->delayed = 0;
+        limit->granted = 0;
+        limit->tokens = rule->burst;
+        limit->updated = now;
+    }
+    limit->burst = rule->burst; // configuration may have been reloaded
+    limit->rate = rule->rate;
+    if (now > limit->updated) {
+        limit->tokens = Min(limit->burst, limit->tokens + limit->rate * (now - limit->updated) / USECS_PER_SEC);
+        limit->updated = now;
+    }
+    if ((tokens = --limit->tokens) < 0) limit->delayed++;
+    else limit->granted++;
+    LWLockRelease(pg_curl_limit.lock);
+    return tokens < 0 ? (long)(-tokens * USECS_PER_SEC / rule->rate) : 0;
+}
+
+typedef struct {
+    char host[PG_CURL_LIMIT_HOST]; // always first, because it is key for hashmap
+    char state; // closed, open or half-open
+    int64 failures;
+    int64 rejected;
+    int64 requests;
+    TimestampTz opened;
+    TimestampTz probe; // start of the only request let through while half-open
+    TimestampTz window;
+} pg_curl_breaker_t;
+
+static struct {
+    double failure_rate;
+    HTAB *hash;
+    int hosts;
+    int min_requests;
+    int open_time;
+    int window;
+    LWLock *lock;
+} pg_curl_breaker = {
+    .hosts = 64,
+    .min_requests = 20,
+    .open_time = 30000,
+    .window = 60000,
+};
+
+static Size pg_curl_breaker_shmem_size(void) {
+    return hash_estimate_size(pg_curl_breaker.hosts, sizeof(pg_curl_breaker_t));
+}
+
+static void pg_curl_breaker_shmem_startup(void) { // called under AddinShmemInitLock
+    pg_curl_breaker.lock = &(GetNamedLWLockTranche("pg_curl breaker"))->lock;
+#if PG_VERSION_NUM >= 140000
+    pg_curl_breaker.hash = ShmemInitHash("pg_curl breaker", pg_curl_breaker.hosts, pg_curl_breaker.hosts, &(HASHCTL){.keysize = PG_CURL_LIMIT_HOST, .entrysize = sizeof(pg_curl_breaker_t)}, HASH_ELEM | HASH_STRINGS);
+#else
+    pg_curl_breaker.hash = ShmemInitHash("pg_curl breaker", pg_curl_breaker.hosts, pg_curl_breaker.hosts, &(HASHCTL){.keysize = PG_CURL_LIMIT_HOST, .entrysize = sizeof(pg_curl_breaker_t)}, HASH_ELEM);
+#endif
+}
+
+static long pg_curl_breaker_admit(pg_curl_t *curl, char *host) { // milliseconds until next probe while host breaker is open, lets one probe through when half-open
+    bool rejected;
+    pg_curl_breaker_t *breaker;
+    TimestampTz now;
+    TimestampTz until = 0;
+    curl->probe = false;
+    host[0] = '\0';
+    if (!pg_curl_breaker.failure_rate || IsBackgroundWorker) return 0; // worker would exit on error, it only feeds the breakers
+    if (!pg_curl_breaker.hash) ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE), errmsg("pg_curl circuit breaker is not available"), errhint("Add pg_curl to shared_preload_libraries.")));
+    pg_curl_easy_host(curl, host);
+    if (!host[0]) return 0;
+    now = GetCurrentTimestamp();
+    LWLockAcquire(pg_curl_breaker.lock, LW_EXCLUSIVE);
+    if ((breaker = hash_search(pg_curl_breaker.hash, host, HASH_FIND, NULL))) switch (breaker->state) {
+        case 'o':
+            if (now < (until = TimestampTzPlusMilliseconds(breaker->opened, pg_curl_breaker.open_time))) break;
+            breaker->probe = 0;
+            breaker->state = 'h'; // fall through
+        case 'h':
+            if (breaker->probe && now < (until = TimestampTzPlusMilliseconds(breaker->probe, pg_curl_breaker.open_time))) break; // lost probe does not keep breaker half-open forever
+            breaker->probe = now;
+            curl->probe = true;
+            break;
+        default: break;
+    }
+    if ((rejected = breaker && breaker->state != 'c' && !curl->probe)) breaker->rejected++;
+    LWLockRelease(pg_curl_breaker.lock);
+    if (rejected) {
+        int usecs;
+        long secs;
+        TimestampDifference(now, until, &secs, &usecs);
+        return secs * 1000 + usecs / 1000 + 1;
+    }
+    return 0;
+}
+
+static bool pg_curl_breaker_reject(pg_curl_t *curl) { // error would abort the loop of all handles, so rejected retry is completed with its own result instead
+    char host[PG_CURL_LIMIT_HOST];
+    MemoryContext oldMemoryContext;
+    if (curl->reserved || !pg_curl_breaker_admit(curl, host)) return false;
+    curl->errcode = CURLE_COULDNT_CONNECT;
+    curl->rejected = true;
+    snprintf(curl->errbuf, sizeof(curl->errbuf), "circuit breaker of host \"%s\" is open", host);
+    oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+    pg_curl.rejected = lappend(pg_curl.rejected, curl);
+    MemoryContextSwitchTo(oldMemoryContext);
+    return true;
+}
+#endif
+
+static int pg_curl_multi_retry_compare(const pairingheap_node *a, const pairingheap_node *b, void *arg) {
+    const pg_curl_t *ca = pairingheap_const_container(pg_curl_t, retry, a);
+    const pg_curl_t *cb = pairingheap_const_container(pg_curl_t, retry, b);
+    return ca->retry_at < cb->retry_at ? 1 : ca->retry_at > cb->retry_at ? -1 : 0;
+}
+
+static void pg_curl_multi_retry_schedule(pg_curl_t *curl, long delay) {
+    TimestampTz now = GetCurrentTimestamp();
+    pg_curl_multi_remove_handle(curl, true);
+    curl->retry_at = delay / 1000 < (PG_INT64_MAX - now) / 1000 ? TimestampTzPlusMilliseconds(now, delay / 1000) : PG_INT64_MAX; // huge backoff max must not wrap around
+    pg_curl.retry.ph_compare = pg_curl_multi_retry_compare;
+    pairingheap_add(&pg_curl.retry, &curl->retry);
+    curl->waiting = true;
+}
+
+static bool pg_curl_multi_add_handle_limit(pg_curl_t *curl) { // prepared handle waits in retry heap until its host grants a token
+    CURLMcode mc;
+#if PG_VERSION_NUM >= 100000
+    long delay;
+    if (!curl->reserved && (delay = pg_curl_limit_acquire(curl)) > 0) {
+        pg_curl_multi_retry_schedule(curl, delay);
+        curl->reserved = true;
+        return true;
+    }
+#endif
+    curl->reserved = false;
+    if ((mc = curl_multi_add_handle(pg_curl.multi, curl->easy)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
+    curl->multi = pg_curl.multi;
+    pg_curl.transfers++;
+    return mc == CURLM_OK;
+}
+
+static bool pg_curl_multi_add_handle_admitted(pg_curl_t *curl) {
+    if (!curl->reserved && (curl->errcode = pg_curl_easy_prepare(curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    return pg_curl_multi_add_handle_limit(curl) && curl->errcode == CURLE_OK;
+}
+
+static bool pg_curl_multi_add_handle_my(pg_curl_t *curl) {
+#if PG_VERSION_NUM >= 100000
+    char host[PG_CURL_LIMIT_HOST];
+    long probe;
+#endif
+    pg_curl_multi_remove_handle(curl, true);
+#if PG_VERSION_NUM >= 100000
+    if (!curl->reserved && (probe = pg_curl_breaker_admit(curl, host))) ereport(ERROR, (errcode(PG_CURL_ERRCODE_BREAKER), errmsg("circuit breaker of host \"%s\" is open", host), errdetail("Next probe in %li ms.", probe))); // before prepare, so that rejected request leaves its sink and previous response alone
+#endif
+    return pg_curl_multi_add_handle_admitted(curl);
+}
+
+typedef struct {
+    CURLcode ec;
+    CURLMcode mc;
+    int running_handles;
+    int timeout_ms;
+    int try;
+    long sleep;
+} pg_curl_multi_state_t;
+
+typedef bool (*pg_curl_done_callback_t)(pg_curl_t *curl, void *arg); // returns false for handles of others
+
+static void pg_curl_multi_done_keep(pg_curl_t *curl) { // shared multi finishes handles of others too, so do not lose their completion
+    MemoryContext oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+    pg_curl.done = lappend(pg_curl.done, curl);
+    MemoryContextSwitchTo(oldMemoryContext);
+}
+
+static bool pg_curl_multi_done_take(pg_curl_t *curl) { // completion of my handle may have been read by a nested loop
+    if (!list_member_ptr(pg_curl.done, curl)) return false;
+    pg_curl.done = list_delete_ptr(pg_curl.done, curl);
+    return true;
+}
+
+static pg_curl_t *pg_curl_multi_done_first(void) {
+    pg_curl_t *curl;
+    if (!pg_curl.done) return NULL;
+    curl = linitial(pg_curl.done);
+    pg_curl.done = list_delete_first(pg_curl.done);
+    return curl;
+}
+
+#if PG_VERSION_NUM >= 100000
+static void pg_curl_multi_socket_action(pg_curl_multi_state_t *state, curl_socket_t s, int ev_bitmask) {
+    if ((state->mc = curl_multi_socket_action(pg_curl.multi, s, ev_bitmask, &state->running_handles)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(state->mc), errmsg("%s", curl_multi_strerror(state->mc))));
+}
+
+static void pg_curl_multi_socket_wait(pg_curl_multi_state_t *state, long timeout) {
+    int nevents;
+    WaitEvent events[64];
+    if (pg_curl_socket.dirty || !pg_curl_socket.set) {
+        ListCell *lc;
+        if (pg_curl_socket.set) FreeWaitEventSet(pg_curl_socket.set);
+#if PG_VERSION_NUM >= 170000
+        pg_curl_socket.set = CreateWaitEventSet(NULL, list_length(pg_curl_socket.list) + 2);
+#else
+        pg_curl_socket.set = CreateWaitEventSet(TopMemoryContext, list_length(pg_curl_socket.list) + 2);
+#endif
+        AddWaitEventToSet(pg_curl_socket.set, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+        AddWaitEventToSet(pg_curl_socket.set, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+        foreach (lc, pg_curl_socket.list) {
+            pg_curl_socket_t *sock = lfirst(lc);
+            uint32 mask = pg_curl_socket_events(sock->what);
+            sock->pos = mask ? AddWaitEventToSet(pg_curl_socket.set, mask, sock->fd, NULL, sock) : -1;
+        }
+        pg_curl_socket.dirty = false;
+    }
+    if (pg_curl_socket.deadline) {
+        long secs;
+        int usecs;
+        TimestampDifference(GetCurrentTimestamp(), pg_curl_socket.deadline, &secs, &usecs);
+        if (timeout < 0 || secs * 1000 + usecs / 1000 < timeout) timeout = secs * 1000 + usecs / 1000;
+    }
+    nevents = WaitEventSetWait(pg_curl_socket.set, timeout, events, lengthof(events), PG_WAIT_EXTENSION);
+    for (int i = 0; i < nevents; i++) {
+        int ev_bitmask = 0;
+        if (events[i].events & WL_POSTMASTER_DEATH) ereport(FATAL, (errcode(ERRCODE_ADMIN_SHUTDOWN), errmsg("terminating pg_curl due to unexpected postmaster exit")));
+        if (events[i].events & WL_LATCH_SET) ResetLatch(MyLatch);
+        if (events[i].events & WL_SOCKET_READABLE) ev_bitmask |= CURL_CSELECT_IN;
+        if (events[i].events & WL_SOCKET_WRITEABLE) ev_bitmask |= CURL_CSELECT_OUT;
+        if (ev_bitmask) pg_curl_multi_socket_action(state, events[i].fd, ev_bitmask);
+    }
+    if (pg_curl_socket.deadline && GetCurrentTimestamp() >= pg_curl_socket.deadline) {
+        pg_curl_socket.deadline = 0;
+        pg_curl_multi_socket_action(state, CURL_SOCKET_TIMEOUT, 0);
+    }
+}
+#endif
+
+static bool pg_curl_multi_pending(pg_curl_multi_state_t *state) {
+    return state->running_handles || !pairingheap_is_empty(&pg_curl.retry) || pg_curl.rejected;
+}
+
+static long pg_curl_easy_backoff(pg_curl_t *curl, long sleep) { // microseconds before next try, sleep grows by multiplier up to max, jitter takes random part off
+    double delay = sleep, max = curl->backoff.max ? curl->backoff.max : Max(sleep, (int64)pg_curl.retry_after_max * 1000); // without max growing delay stops at pg_curl.retry_after_max, so that it stays finite
+    for (int i = 1; i < curl->try && curl->backoff.multiplier > 1 && delay < max; i++) delay *= curl->backoff.multiplier;
+    if (delay > max) delay = max;
+    if (delay > LONG_MAX) delay = LONG_MAX;
+#if PG_VERSION_NUM >= 150000
+    if (curl->backoff.jitter) delay -= delay * curl->backoff.jitter * pg_prng_double(&pg_global_prng_state);
+#else
+    if (curl->backoff.jitter) delay -= delay * curl->backoff.jitter * ((double)random() / MAX_RANDOM_VALUE);
+#endif
+    return (long)delay;
+}
+
+static long pg_curl_multi_retry_my(long timeout) { // re-adds handles whose time has come, returns wait timeout up to the next one
+    TimestampTz now = GetCurrentTimestamp();
+    while (!pairingheap_is_empty(&pg_curl.retry)) {
+        int try;
+        pg_curl_t *curl = pairingheap_container(pg_curl_t, retry, pairingheap_first(&pg_curl.retry));
+        if (curl->retry_at > now) {
+            int usecs;
+            long secs;
+            TimestampDifference(now, curl->retry_at, &secs, &usecs);
+            return Min(timeout, secs * 1000 + usecs / 1000 + 1);
+        }
+        pairingheap_remove_first(&pg_curl.retry);
+        curl->waiting = false;
+#if PG_VERSION_NUM >= 100000
+        if (pg_curl_breaker_reject(curl)) continue;
+#endif
+        try = curl->try;
+        pg_curl.current = curl;
+        pg_curl_multi_add_handle_admitted(curl);
+        pg_curl.current = NULL;
+        curl->try = try;
+    }
+    return timeout;
+}
+
+static void pg_curl_sleep_my(TimestampTz until) { // unlike pg_usleep wakes up on cancel
+    for (;;) {
+        int usecs;
+        long secs;
+        CHECK_FOR_INTERRUPTS();
+        TimestampDifference(GetCurrentTimestamp(), until, &secs, &usecs);
+        if (!secs && !usecs) break;
+#if PG_VERSION_NUM >= 100000
+        if (WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, secs * 1000 + usecs / 1000 + 1, PG_WAIT_EXTENSION) & WL_POSTMASTER_DEATH) ereport(FATAL, (errcode(ERRCODE_ADMIN_SHUTDOWN), errmsg("terminating pg_curl due to unexpected postmaster exit")));
+        ResetLatch(MyLatch);
+#else
+        pg_usleep(Min(secs * 1000000L + usecs, 100000L));
+#endif
+    }
+}
+
+static void pg_curl_multi_wait_my(pg_curl_multi_state_t *state) {
+    long timeout;
+    CHECK_FOR_INTERRUPTS();
+    timeout = pg_curl_multi_retry_my(state->timeout_ms);
+    if (pg_curl.rejected) timeout = 0; // rejected retries are already complete
+#if PG_VERSION_NUM >= 100000
+    if (pg_curl_socket.list || pg_curl_socket.deadline || !pairingheap_is_empty(&pg_curl.retry)) pg_curl_multi_socket_wait(state, timeout); // wakes up on socket readiness, libcurl timer, next retry or latch
+    else pg_curl_multi_socket_action(state, CURL_SOCKET_TIMEOUT, 0); // nothing to wait for, only refresh running handles
+    CHECK_FOR_INTERRUPTS();
+#else
+    {
+        int numfds = 0;
+        if ((state->mc = curl_multi_wait(pg_curl.multi, NULL, 0, timeout, &numfds)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(state->mc), errmsg("%s", curl_multi_strerror(state->mc))));
+        if (!numfds && !pairingheap_is_empty(&pg_curl.retry)) pg_curl_sleep_my(TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout)); // curl_multi_wait returns at once without sockets
+    }
+    if ((state->mc = curl_multi_perform(pg_curl.multi, &state->running_handles)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(state->mc), errmsg("%s", curl_multi_strerror(state->mc))));
+#endif
+}
+
+static bool pg_curl_easy_permanent(CURLcode ec) {
+    switch (ec) {
+        case CURLE_OK: case CURLE_UNSUPPORTED_PROTOCOL: case CURLE_FAILED_INIT: case CURLE_URL_MALFORMAT: case CURLE_NOT_BUILT_IN: case CURLE_FUNCTION_NOT_FOUND: case CURLE_BAD_FUNCTION_ARGUMENT: case CURLE_UNKNOWN_OPTION: case CURLE_LDAP_INVALID_URL: return true;
+        default: return false;
+    }
+}
+
+static void pg_curl_easy_warning(pg_curl_t *curl, int try) {
+    if (curl->errbuf[0]) ereport(WARNING, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode)), errdetail("%s", curl->errbuf), errcontext("try %i", try)));
+    else ereport(WARNING, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode)), errcontext("try %i", try)));
+}
+
+static bool pg_curl_easy_idempotent(pg_curl_t *curl) {
+#if CURL_AT_LEAST_VERSION(7, 72, 0)
+    CURLcode ec;
+    char *method = NULL;
+    if ((ec = curl_easy_getinfo(curl->easy, CURLINFO_EFFECTIVE_METHOD, &method)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if (!method) return false;
+    return !pg_strcasecmp(method, "GET") || !pg_strcasecmp(method, "HEAD") || !pg_strcasecmp(method, "PUT") || !pg_strcasecmp(method, "DELETE") || !pg_strcasecmp(method, "OPTIONS") || !pg_strcasecmp(method, "TRACE");
+#else
+    return !curl->postfield.len && !curl->readdata.len && !curl->readcursor[0]; // without effective method only requests without body are known to be safe
+#endif
+}
+
+static long pg_curl_easy_retry_after(pg_curl_t *curl) { // microseconds asked by Retry-After, negative when absent
+#if CURL_AT_LEAST_VERSION(7, 66, 0)
+    CURLcode ec;
+    curl_off_t retry_after;
+    int64 max = Min(curl->backoff.max ? curl->backoff.max : (int64)pg_curl.retry_after_max * 1000, LONG_MAX); // server must not park the handle for hours
+    if ((ec = curl_easy_getinfo(curl->easy, CURLINFO_RETRY_AFTER, &retry_after)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if (retry_after <= 0) return -1;
+    if (retry_after > max / 1000000) return max;
+    return retry_after * 1000000;
+#else
+    return -1;
+#endif
+}
+
+static bool pg_curl_easy_retry_http(pg_curl_t *curl, long *delay) { // successful transfer whose response code asks for retry
+    CURLcode ec;
+    long response_code = 0;
+    if (!curl->retry_http.status) return false;
+    if ((ec = curl_easy_getinfo(curl->easy, CURLINFO_RESPONSE_CODE, &response_code)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if (response_code < 100 || response_code > 599 || !bms_is_member(response_code, curl->retry_http.status)) return false;
+    if (!curl->retry_http.any_method && !pg_curl_easy_idempotent(curl)) return false;
+    *delay = pg_curl_easy_retry_after(curl);
+    ereport(WARNING, (errmsg("response code %li", response_code), errcontext("try %i", curl->try)));
+    return true;
+}
+
+#if PG_VERSION_NUM >= 100000
+static void pg_curl_breaker_evict(TimestampTz now) { // closed breaker without failures in its window is the same as a new one, so the oldest of them makes room, called under exclusive lock
+    HASH_SEQ_STATUS status;
+    pg_curl_breaker_t *breaker;
+    pg_curl_breaker_t *stale = NULL;
+    hash_seq_init(&status, pg_curl_breaker.hash);
+    while ((breaker = hash_seq_search(&status))) {
+        if (breaker->state != 'c' || (breaker->failures && now < TimestampTzPlusMilliseconds(breaker->window, pg_curl_breaker.window))) continue;
+        if (!stale || breaker->window < stale->window) stale = breaker;
+    }
+    if (stale) hash_search(pg_curl_breaker.hash, stale->host, HASH_REMOVE, NULL);
+}
+
+static void pg_curl_breaker_report(pg_curl_t *curl) { // counts finished transfer against its host, probe alone closes or reopens half-open breaker
+    bool failure;
+    bool probe = curl->probe;
+    char host[PG_CURL_LIMIT_HOST];
+    CURLcode ec;
+    long response_code = 0;
+    pg_curl_breaker_t *breaker;
+    TimestampTz now;
+    curl->probe = false;
+    if (!pg_curl_breaker.failure_rate || !pg_curl_breaker.hash) return;
+    if (curl->errcode == CURLE_ABORTED_BY_CALLBACK || curl->limit || (curl->errcode != CURLE_OK && pg_curl_easy_permanent(curl->errcode))) return; // not a fault of the host
+    if ((ec = curl_easy_getinfo(curl->easy, CURLINFO_RESPONSE_CODE, &response_code)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    failure = curl->errcode != CURLE_OK || response_code >= 500;
+    pg_curl_easy_host(curl, host);
+    if (!host[0]) return;
+    now = GetCurrentTimestamp();
+    LWLockAcquire(pg_curl_breaker.lock, LW_EXCLUSIVE);
+    if (!(breaker = hash_search(pg_curl_breaker.hash, host, HASH_FIND, NULL))) {
+        if (failure && hash_get_num_entries(pg_curl_breaker.hash) >= pg_curl_breaker.hosts) pg_curl_breaker_evict(now);
+        if (!failure || hash_get_num_entries(pg_curl_breaker.hash) >= pg_curl_breaker.hosts || !(breaker = hash_search(pg_curl_breaker.hash, host, HASH_ENTER_NULL, NULL))) { // healthy hosts take no space, a host that still does not fit is not broken
+            LWLockRelease(pg_curl_breaker.lock);
+            return;
+        }
+        breaker->failures = 0;
+        breaker->opened = 0;
+        breaker->probe = 0;
+        breaker->rejected = 0;
+        breaker->requests = 0;
+        breaker->state = 'c';
+        breaker->window = now;
+    }
+    if (probe && breaker->state == 'h') {
+        breaker->probe = 0;
+        breaker->failures = 0;
+        breaker->requests = 0;
+        breaker->window = now;
+        if (failure) breaker->opened = now;
+        breaker->state = failure ? 'o' : 'c';
+    } else if (breaker->state == 'c') { // transfers started before the breaker opened do not count
+        if (now >= TimestampTzPlusMilliseconds(breaker->window, pg_curl_breaker.window)) {
+            breaker->failures = 0;
+            breaker->requests = 0;
+            breaker->window = now;
+        }
+        breaker->requests++;
+        if (failure) breaker->failures++;
+        if (breaker->requests >= pg_curl_breaker.min_requests && breaker->failures >= pg_curl_breaker.failure_rate * breaker->requests) {
+            breaker->opened = now;
+            breaker->state = 'o';
+        }
+    }
+    LWLockRelease(pg_curl_breaker.lock);
+}
+#endif
+
+static pg_curl_t *pg_curl_multi_info_read_my(pg_curl_multi_state_t *state) {
+    CURLMsg *msg;
+    int msgs_in_queue;
+    if (pg_curl.rejected) {
+        pg_curl_t *curl = linitial(pg_curl.rejected);
+        pg_curl.rejected = list_delete_first(pg_curl.rejected);
+        state->ec = curl->errcode;
+        return pg_curl.current = curl;
+    }
+    while ((msg = curl_multi_info_read(pg_curl.multi, &msgs_in_queue))) if (msg->msg == CURLMSG_DONE) {
+        CURLcode ec;
+        pg_curl_t *curl;
+        if ((ec = curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+        pg_curl.current = curl;
+        curl->errcode = msg->data.result;
+        curl->try++;
+#if PG_VERSION_NUM >= 100000
+        pg_curl_breaker_report(curl);
+#endif
+        if ((state->ec = ec = curl->errcode) != CURLE_ABORTED_BY_CALLBACK && !pg_curl_easy_permanent(ec) && !curl->error && !curl->limit && !curl->readcursor[0] && curl->try < state->try) { // query cursor can not be read again
+            pg_curl_easy_warning(curl, curl->try);
+            pg_curl_multi_retry_schedule(curl, pg_curl_easy_backoff(curl, state->sleep));
+            continue;
+        }
+        if (ec == CURLE_OK && !curl->readcursor[0] && curl->try < state->try) {
+            long delay = -1;
+            if (pg_curl_easy_retry_http(curl, &delay)) {
+                pg_curl_multi_retry_schedule(curl, delay >= 0 ? delay : pg_curl_easy_backoff(curl, state->sleep));
+                continue;
+            }
+        }
+        pg_curl_multi_remove_handle(curl, true);
+        pg_curl_callback_rethrow(curl);
+        return curl;
+    }
+    pg_curl.current = NULL;
+    return NULL;
+}
+
+static bool pg_curl_multi_perform_my(int try, long sleep, int timeout_ms, pg_curl_done_callback_t done, void *arg) {
+    pg_curl_multi_state_t state = {.ec = CURL_LAST, .sleep = sleep, .timeout_ms = timeout_ms, .try = try};
     do {
-        bool sleep_need = false;
+        pg_curl_t *curl;
+        pg_curl_multi_wait_my(&state);
+        while ((curl = pg_curl_multi_info_read_my(&state))) if (done && !done(curl, arg)) pg_curl_multi_done_keep(curl);
+    } while (pg_curl_multi_pending(&state));
+    return state.ec == CURLE_OK && state.mc == CURLM_OK;
+}
+
+static void pg_curl_slist_copy(struct curl_slist **copy, struct curl_slist *list) { // partial copy is freed with its handle
+    for (; list; list = list->next) {
+        struct curl_slist *temp = *copy;
+        if ((temp = curl_slist_append(temp, list->data))) *copy = temp; else ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_slist_append")));
+    }
+}
+
+static pg_curl_t *pg_curl_easy_snapshot(pg_curl_t *curl, MemoryContext context) { // deferred request must not see later setopt or reset of its handle, so it gets a copy of the handle and of the memory its options point to
+    CURLcode ec;
+    MemoryContext oldMemoryContext;
+    pg_curl_t *copy = MemoryContextAllocZero(context, sizeof(*copy));
+    pg_curl_easy_init_my(copy, context);
+    curl_easy_cleanup(copy->easy);
+    if (!(copy->easy = curl_easy_duphandle(curl->easy))) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_easy_duphandle")));
+    oldMemoryContext = MemoryContextSwitchTo(context);
+    copy->conname = pstrdup(curl->conname);
+    copy->retry_http.status = bms_copy(curl->retry_http.status);
+    MemoryContextSwitchTo(oldMemoryContext);
+    copy->backoff = curl->backoff;
+    copy->max_header_bytes = curl->max_header_bytes;
+    copy->max_response_bytes = curl->max_response_bytes;
+    copy->retry_http.any_method = curl->retry_http.any_method;
+    appendBinaryStringInfo(&copy->postfield, curl->postfield.data, curl->postfield.len);
+    appendBinaryStringInfo(&copy->readdata, curl->readdata.data, curl->readdata.len);
+    appendBinaryStringInfo(&copy->url, curl->url.data, curl->url.len);
+    pg_curl_slist_copy(&copy->header, curl->header);
+    pg_curl_slist_copy(&copy->postquote, curl->postquote);
+    pg_curl_slist_copy(&copy->prequote, curl->prequote);
+    pg_curl_slist_copy(&copy->quote, curl->quote);
+#if CURL_AT_LEAST_VERSION(7, 20, 0)
+    pg_curl_slist_copy(&copy->recipient, curl->recipient);
+#endif
+    if ((ec = curl_easy_setopt(copy->easy, CURLOPT_DEBUGDATA, copy)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(copy->easy, CURLOPT_POSTQUOTE, copy->postquote)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec)))); // prepare sets lists only when present, but duplicate still points to those of the handle
+    if ((ec = curl_easy_setopt(copy->easy, CURLOPT_PREQUOTE, copy->prequote)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(copy->easy, CURLOPT_QUOTE, copy->quote)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+#if CURL_AT_LEAST_VERSION(7, 32, 0)
+    if ((ec = curl_easy_setopt(copy->easy, CURLOPT_MAIL_RCPT, copy->recipient)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+#endif
+    if ((ec = curl_easy_setopt(copy->easy, CURLOPT_READDATA, copy)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((copy->errcode = pg_curl_easy_prepare(copy)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(copy->errcode), errmsg("%s", curl_easy_strerror(copy->errcode))));
+    return copy;
+}
+
+static void pg_curl_easy_adopt(pg_curl_deferred_t *deferred) { // handle takes over its last deferred request, so that its result can be read after commit
+    pg_curl_t *copy = deferred->curl;
+    pg_curl_t *curl = deferred->origin;
+    CURL *easy = curl->easy;
+    CURLcode ec;
+    MemoryContext data_in_context = curl->data_in_context;
+    StringInfoData data_in = curl->data_in;
+    if (curl->multi || curl->waiting) return; // handle runs a request of its own
+    curl->easy = copy->easy;
+    copy->easy = easy; // freed with the copy
+    curl->data_in = copy->data_in;
+    curl->data_in_context = copy->data_in_context;
+    MemoryContextSetParent(curl->data_in_context, pg_curl.context);
+    copy->data_in = data_in;
+    copy->data_in_context = data_in_context;
+    MemoryContextSetParent(copy->data_in_context, deferred->context);
+    resetStringInfo(&curl->header_in);
+    appendBinaryStringInfo(&curl->header_in, copy->header_in.data, copy->header_in.len);
+    if (curl->error) FreeErrorData(curl->error);
+    curl->error = copy->error;
+    copy->error = NULL;
+    curl->errcode = copy->errcode;
+    curl->limit = copy->limit;
+    curl->try = copy->try;
+    strlcpy(curl->errbuf, copy->errbuf, sizeof(curl->errbuf));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_DEBUGDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_ERRORBUFFER, curl->errbuf)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_HEADERDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_HTTPHEADER, curl->header)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_POSTQUOTE, curl->postquote)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_PREQUOTE, curl->prequote)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_PRIVATE, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_QUOTE, curl->quote)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_READDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_WRITEDATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+#if CURL_AT_LEAST_VERSION(7, 32, 0)
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_MAIL_RCPT, curl->recipient)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if ((ec = curl_easy_setopt(curl->easy, CURLOPT_XFERINFODATA, curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+#endif
+    if (copy->postfield.len && (ec = curl_easy_setopt(curl->easy, CURLOPT_POSTFIELDS, curl->postfield.data)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec)))); // body of the copy is freed with it
+    if (copy->postfield.len && (ec = curl_easy_setopt(curl->easy, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)curl->postfield.len)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+}
+
+static pg_curl_deferred_t *pg_curl_multi_deferred_my(List *pending, pg_curl_t *curl) {
+    ListCell *lc;
+    foreach (lc, pending) if (((pg_curl_deferred_t *)lfirst(lc))->curl == curl) return lfirst(lc);
+    return NULL;
+}
+
+static void pg_curl_multi_perform_deferred(List *pending) { // commit holds interrupts, so cancel only aborts transfers through progress callback and pg_curl.deferred_timeout bounds the wait
+    ListCell *lc;
+    MemoryContext oldMemoryContext = CurrentMemoryContext;
+    PG_TRY(); {
+        int remaining = list_length(pending);
+        List *last = NIL;
+        pg_curl_multi_state_t state = {.ec = CURL_LAST, .running_handles = 1, .try = 1};
+        TimestampTz deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), pg_curl.deferred_timeout);
+        foreach (lc, pending) {
+            pg_curl_deferred_t *deferred = lfirst(lc);
+            ListCell *cell;
+            deferred->last = false;
+            foreach (cell, last) if (((pg_curl_deferred_t *)lfirst(cell))->origin == deferred->origin) break;
+            if (cell) lfirst(cell) = deferred; else last = lappend(last, deferred);
+#if PG_VERSION_NUM >= 100000
+            if (pg_curl_breaker_reject(deferred->curl)) continue; // read below like a finished transfer
+#endif
+            pg_curl_multi_add_handle_limit(deferred->curl);
+        }
+        foreach (lc, last) ((pg_curl_deferred_t *)lfirst(lc))->last = true;
+        while (remaining && pg_curl_multi_pending(&state)) {
+            long secs;
+            int usecs;
+            pg_curl_t *curl;
+            TimestampDifference(GetCurrentTimestamp(), deadline, &secs, &usecs);
+            if ((!secs && !usecs) || QueryCancelPending || ProcDiePending) {
+                foreach (lc, pending) pg_curl_multi_remove_handle(((pg_curl_deferred_t *)lfirst(lc))->curl, false);
+                ereport(WARNING, (errcode(ERRCODE_QUERY_CANCELED), errmsg("deferred pg_curl requests cancelled after commit"), errdetail_plural("%i request was not finished.", "%i requests were not finished.", remaining, remaining), errhint("Increase pg_curl.deferred_timeout.")));
+                break;
+            }
+            state.timeout_ms = Min(secs * 1000 + usecs / 1000 + 1, 1000);
+            pg_curl_multi_wait_my(&state);
+            while ((curl = pg_curl_multi_info_read_my(&state))) {
+                if (pg_curl_multi_deferred_my(pending, curl)) remaining--;
+                else pg_curl_multi_done_keep(curl);
+            }
+        }
+        foreach (lc, last) pg_curl_easy_adopt(lfirst(lc));
+    } PG_CATCH(); {
+        ErrorData *edata;
+        MemoryContextSwitchTo(oldMemoryContext);
+        edata = CopyErrorData();
+        FlushErrorState();
+        ereport(WARNING, (errcode(edata->sqlerrcode), errmsg("deferred pg_curl requests failed: %s", edata->message))); // transaction is already committed
+        FreeErrorData(edata);
+    } PG_END_TRY();
+    foreach (lc, pending) MemoryContextDelete(((pg_curl_deferred_t *)lfirst(lc))->context);
+}
+
+static void pg_curl_xact_callback(XactEvent event, void *arg) {
+    List *pending = pg_curl.pending;
+    switch (event) {
+        case XACT_EVENT_PRE_PREPARE: if (pending) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("cannot prepare a transaction with deferred pg_curl requests"))); break;
+        case XACT_EVENT_COMMIT: pg_curl.pending = NIL; if (pending && pg_curl.multi) pg_curl_multi_perform_deferred(pending); break;
+        case XACT_EVENT_ABORT: pg_curl.pending = NIL; break; // snapshots go with the transaction memory
+        default: break;
+    }
+}
+
+static void pg_curl_subxact_callback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg) {
+    ListCell *lc;
+    List *pending = NIL;
+    switch (event) {
+        case SUBXACT_EVENT_COMMIT_SUB: foreach (lc, pg_curl.pending) {
+            pg_curl_deferred_t *deferred = lfirst(lc);
+            if (deferred->subid == mySubid) deferred->subid = parentSubid;
+        } break;
+        case SUBXACT_EVENT_ABORT_SUB: {
+            MemoryContext oldMemoryContext = MemoryContextSwitchTo(TopTransactionContext);
+            foreach (lc, pg_curl.pending) {
+                pg_curl_deferred_t *deferred = lfirst(lc);
+                if (deferred->subid != mySubid) pending = lappend(pending, deferred);
+                else MemoryContextDelete(deferred->context);
+            }
+            MemoryContextSwitchTo(oldMemoryContext);
+            pg_curl.pending = pending;
+        } break;
+        default: break;
+    }
+}
+
+static bool pg_curl_multi_defer(pg_curl_t *curl) { // every call queues its own snapshot, so that trigger-fired calls on one handle are all performed
+    static bool registered = false;
+    MemoryContext context;
+    MemoryContext oldMemoryContext;
+    pg_curl_deferred_t *deferred;
+    if (curl->sink.kind) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("pg_curl.deferred does not support sinks"), errhint("Call curl_easy_reset first.")));
+    if (curl->readcursor[0]) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("pg_curl.deferred does not support readquery"), errhint("Call curl_easy_reset first."))); // cursor is closed before commit
+    if (!registered) {
+        RegisterXactCallback(pg_curl_xact_callback, NULL);
+        RegisterSubXactCallback(pg_curl_subxact_callback, NULL);
+        registered = true;
+    }
+#if PG_VERSION_NUM >= 90600
+    context = AllocSetContextCreate(TopTransactionContext, "pg_curl deferred", ALLOCSET_DEFAULT_SIZES);
+#else
+    context = AllocSetContextCreate(TopTransactionContext, "pg_curl deferred", ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+#endif
+    oldMemoryContext = MemoryContextSwitchTo(TopTransactionContext);
+    deferred = palloc(sizeof(*deferred));
+    deferred->context = context;
+    deferred->curl = pg_curl_easy_snapshot(curl, context);
+    deferred->last = false;
+    deferred->origin = curl;
+    deferred->subid = GetCurrentSubTransactionId();
+    pg_curl.pending = lappend(pg_curl.pending, deferred);
+    MemoryContextSwitchTo(oldMemoryContext);
+    return true;
+}
+
+EXTENSION(pg_curl_multi_add_handle) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    PG_RETURN_BOOL(pg_curl.deferred ? pg_curl_multi_defer(curl) : pg_curl_multi_add_handle_my(curl));
+}
+
+EXTENSION(pg_curl_multi_perform) {
+    int timeout_ms;
+    int try;
+    long sleep;
+    if ((try = PG_ARGISNULL(0) ? 1 : PG_GETARG_INT32(0)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_perform invalid argument try %i", try), errhint("Argument try must be positive!")));
+    if ((sleep = PG_ARGISNULL(1) ? 1000000 : PG_GETARG_INT64(1)) < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_perform invalid argument sleep %li", sleep), errhint("Argument sleep must be non-negative!")));
+    if ((timeout_ms = PG_ARGISNULL(2) ? 1000 : PG_GETARG_INT32(2)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_perform invalid argument timeout_ms %i", timeout_ms), errhint("Argument timeout_ms must be positive!")));
+    PG_RETURN_BOOL(pg_curl_multi_perform_my(try, sleep, timeout_ms, NULL, NULL));
+}
+
+EXTENSION(pg_curl_easy_perform) {
+    return pg_curl_multi_add_handle_my(pg_curl_easy_init("unknown")) && pg_curl_multi_perform(fcinfo);
+}
+
+static double pg_curl_easy_getinfo_double_my(pg_curl_t *curl, CURLINFO info) {
+    CURLcode ec;
+    double value;
+    if ((ec = curl_easy_getinfo(curl->easy, info, &value)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    return value;
+}
+
+EXTENSION(pg_curl_multi_info_read) {
+    bool nulls[4] = {false};
+    CURLcode ec;
+    Datum values[4];
+    FuncCallContext *funcctx;
+    long response_code = 0;
+    pg_curl_multi_state_t *state;
+    pg_curl_t *curl;
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldMemoryContext;
+        TupleDesc tupdesc;
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldMemoryContext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("return type must be a row type")));
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+        funcctx->user_fctx = state = palloc0(sizeof(*state));
+        MemoryContextSwitchTo(oldMemoryContext);
+        state->ec = CURL_LAST;
+        state->running_handles = 1;
+        if ((state->try = PG_ARGISNULL(0) ? 1 : PG_GETARG_INT32(0)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_info_read invalid argument try %i", state->try), errhint("Argument try must be positive!")));
+        if ((state->sleep = PG_ARGISNULL(1) ? 1000000 : PG_GETARG_INT64(1)) < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_info_read invalid argument sleep %li", state->sleep), errhint("Argument sleep must be non-negative!")));
+        if ((state->timeout_ms = PG_ARGISNULL(2) ? 1000 : PG_GETARG_INT32(2)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_info_read invalid argument timeout_ms %i", state->timeout_ms), errhint("Argument timeout_ms must be positive!")));
+        pg_curl_multi_init();
+    }
+    funcctx = SRF_PERCALL_SETUP();
+    state = funcctx->user_fctx;
+    while (!(curl = pg_curl_multi_done_first()) && !(curl = pg_curl_multi_info_read_my(state))) {
+        if (!pg_curl_multi_pending(state)) SRF_RETURN_DONE(funcctx);
+        pg_curl_multi_wait_my(state);
+    }
+    if (curl->conname) values[0] = DirectFunctionCall1(namein, CStringGetDatum(curl->conname)); else nulls[0] = true;
+    values[1] = Int64GetDatum(curl->errcode);
+    if ((ec = curl_easy_getinfo(curl->easy, CURLINFO_RESPONSE_CODE, &response_code)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    values[2] = Int64GetDatum(response_code);
+    values[3] = Float8GetDatum(pg_curl_easy_getinfo_double_my(curl, CURLINFO_TOTAL_TIME));
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
+}
+
+static Tuplestorestate *pg_curl_tuplestore(PG_FUNCTION_ARGS, TupleDesc *tupdesc) {
+    MemoryContext oldMemoryContext;
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+    Tuplestorestate *tupstore;
+    if (!rsinfo || !IsA(rsinfo, ReturnSetInfo)) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("set-valued function called in context that cannot accept a set")));
+    if (!(rsinfo->allowedModes & SFRM_Materialize)) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("materialize mode required, but it is not allowed in this context")));
+    if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE) ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("return type must be a row type")));
+    oldMemoryContext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+    *tupdesc = CreateTupleDescCopy(*tupdesc);
+    tupstore = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+    MemoryContextSwitchTo(oldMemoryContext);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = *tupdesc;
+    return tupstore;
+}
+
+typedef struct {
+    int count;
+    pg_curl_t **curl;
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore;
+} pg_curl_batch_t;
+
+static bool pg_curl_multi_batch_done(pg_curl_t *curl, void *arg) {
+    bool nulls[11] = {false};
+    CURLcode ec;
+    Datum values[11];
+    long response_code = 0;
+    pg_curl_batch_t *batch = arg;
+    if (curl->index <= 0 || curl->index > batch->count || batch->curl[curl->index - 1] != curl) return false;
+    values[0] = Int32GetDatum(curl->index);
+    values[1] = Int64GetDatum(curl->errcode);
+    if (curl->errbuf[0]) values[2] = CStringGetTextDatum(curl->errbuf); else nulls[2] = true;
+    if ((ec = curl_easy_getinfo(curl->easy, CURLINFO_RESPONSE_CODE, &response_code)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    values[3] = Int64GetDatum(response_code);
+    if (PG_CURL_VARLENA_LEN(&curl->header_in)) values[4] = pg_curl_varlena(&curl->header_in); else nulls[4] = true;
+    if (PG_CURL_VARLENA_LEN(&curl->data_in)) values[5] = pg_curl_varlena(&curl->data_in); else nulls[5] = true;
+    values[6] = Float8GetDatum(pg_curl_easy_getinfo_double_my(curl, CURLINFO_NAMELOOKUP_TIME));
+    values[7] = Float8GetDatum(pg_curl_easy_getinfo_double_my(curl, CURLINFO_CONNECT_TIME));
+#if CURL_AT_LEAST_VERSION(7, 19, 0)
+    values[8] = Float8GetDatum(pg_curl_easy_getinfo_double_my(curl, CURLINFO_APPCONNECT_TIME));
+#else
+    nulls[8] = true;
+#endif
+    values[9] = Float8GetDatum(pg_curl_easy_getinfo_double_my(curl, CURLINFO_STARTTRANSFER_TIME));
+    values[10] = Float8GetDatum(pg_curl_easy_getinfo_double_my(curl, CURLINFO_TOTAL_TIME));
+    tuplestore_putvalues(batch->tupstore, batch->tupdesc, values, nulls);
+    return true;
+}
+
+static void pg_curl_header_append_jsonb(pg_curl_t *curl, Jsonb *jsonb) {
+    char *name = NULL;
+    int r;
+    JsonbIterator *it;
+    JsonbValue v;
+    if (!JB_ROOT_IS_OBJECT(jsonb)) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("headers must be json objects")));
+    it = JsonbIteratorInit(&jsonb->root);
+    while ((r = JsonbIteratorNext(&it, &v, true)) != WJB_DONE) switch (r) {
+        case WJB_KEY: name = pnstrdup(v.val.string.val, v.val.string.len); break;
+        case WJB_VALUE: {
+            char *value;
+            switch (v.type) {
+                case jbvBool: value = pstrdup(v.val.boolean ? "true" : "false"); break;
+                case jbvNull: value = NULL; break;
+                case jbvNumeric: value = DatumGetCString(DirectFunctionCall1(numeric_out, NumericGetDatum(v.val.numeric))); break;
+                case jbvString: value = pnstrdup(v.val.string.val, v.val.string.len); break;
+                default: ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("header %s must be scalar", name)));
+            }
+            if (curl) pg_curl_header_append_my(curl, name, value);
+            pfree(name);
+            if (value) pfree(value);
+        } break;
+        default: break;
+    }
+}
+
+static void pg_curl_easy_request_my(pg_curl_t *curl, const char *url, int url_len, const char *method, const char *body, int body_len, Jsonb *headers) {
+    CURLcode ec = CURLE_OK;
+    appendBinaryStringInfo(&curl->url, url, url_len);
+    if (method && !pg_strcasecmp(method, "HEAD")) ec = curl_easy_setopt(curl->easy, CURLOPT_NOBODY, 1L);
+    else if (method) ec = curl_easy_setopt(curl->easy, CURLOPT_CUSTOMREQUEST, method);
+    if (ec != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if (body) appendBinaryStringInfo(&curl->postfield, body, body_len);
+    if (headers) pg_curl_header_append_jsonb(curl, headers);
+}
+
+static Datum *pg_curl_multi_batch_array(PG_FUNCTION_ARGS, int arg, Oid elmtype, bool **nulls, int *count) {
+    ArrayType *array;
+    Datum *elems;
+    int16 elmlen;
+    bool elmbyval;
+    char elmalign;
+    int nelems;
+    if (PG_ARGISNULL(arg)) return NULL;
+    array = PG_GETARG_ARRAYTYPE_P(arg);
+    if (ARR_NDIM(array) > 1) ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR), errmsg("curl_multi_batch requires one-dimensional arrays")));
+    get_typlenbyvalalign(elmtype, &elmlen, &elmbyval, &elmalign);
+    deconstruct_array(array, elmtype, elmlen, elmbyval, elmalign, &elems, nulls, &nelems);
+    if (*count < 0) *count = nelems;
+    else if (*count != nelems) ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR), errmsg("curl_multi_batch requires arrays of equal length"), errdetail("Expected %i elements, got %i.", *count, nelems)));
+    return elems;
+}
+
+static void pg_curl_multi_batch_cleanup(pg_curl_batch_t *batch, MemoryContext context) {
+    for (int i = 0; i < batch->count; i++) if (batch->curl[i]) pg_curl_multi_remove_handle(batch->curl[i], false);
+    MemoryContextDelete(context);
+}
+
+EXTENSION(pg_curl_multi_batch) {
+    bool *body_nulls = NULL, *header_nulls = NULL, *method_nulls = NULL, *url_nulls = NULL;
+    Datum *bodies, *headers, *methods, *urls;
+    int count = -1;
+    int timeout_ms;
+    int try;
+    long sleep;
+    MemoryContext context;
+    pg_curl_batch_t batch = {0};
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_multi_batch requires argument urls")));
+    urls = pg_curl_multi_batch_array(fcinfo, 0, TEXTOID, &url_nulls, &count);
+    methods = pg_curl_multi_batch_array(fcinfo, 1, TEXTOID, &method_nulls, &count);
+    bodies = pg_curl_multi_batch_array(fcinfo, 2, BYTEAOID, &body_nulls, &count);
+    headers = pg_curl_multi_batch_array(fcinfo, 3, JSONBOID, &header_nulls, &count);
+    if ((try = PG_ARGISNULL(4) ? 1 : PG_GETARG_INT32(4)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_batch invalid argument try %i", try), errhint("Argument try must be positive!")));
+    if ((sleep = PG_ARGISNULL(5) ? 1000000 : PG_GETARG_INT64(5)) < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_batch invalid argument sleep %li", sleep), errhint("Argument sleep must be non-negative!")));
+    if ((timeout_ms = PG_ARGISNULL(6) ? 1000 : PG_GETARG_INT32(6)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_multi_batch invalid argument timeout_ms %i", timeout_ms), errhint("Argument timeout_ms must be positive!")));
+    batch.tupstore = pg_curl_tuplestore(fcinfo, &batch.tupdesc);
+    if (!count) return (Datum)0;
+    pg_curl_multi_init();
+#if PG_VERSION_NUM >= 90600
+    context = AllocSetContextCreate(pg_curl.context, "pg_curl batch", ALLOCSET_DEFAULT_SIZES);
+#else
+    context = AllocSetContextCreate(pg_curl.context, "pg_curl batch", ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+#endif
+    batch.curl = MemoryContextAllocZero(context, count * sizeof(*batch.curl));
+    batch.count = count;
+    PG_TRY(); {
+        for (int i = 0; i < count; i++) {
+            bytea *body = bodies && !body_nulls[i] ? DatumGetByteaPP(bodies[i]) : NULL;
+            char *method = methods && !method_nulls[i] ? TextDatumGetCString(methods[i]) : NULL;
+            pg_curl_t *curl;
+            text *url;
+            if (url_nulls[i]) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_multi_batch requires non-null urls"), errcontext("index %i", i + 1)));
+            curl = batch.curl[i] = MemoryContextAllocZero(context, sizeof(*curl));
+            curl->index = i + 1;
+            pg_curl_easy_init_my(curl, context);
+            url = DatumGetTextPP(urls[i]);
+#if PG_VERSION_NUM >= 110000
+            pg_curl_easy_request_my(curl, VARDATA_ANY(url), VARSIZE_ANY_EXHDR(url), method, body ? VARDATA_ANY(body) : NULL, body ? VARSIZE_ANY_EXHDR(body) : 0, headers && !header_nulls[i] ? DatumGetJsonbP(headers[i]) : NULL);
+#else
+            pg_curl_easy_request_my(curl, VARDATA_ANY(url), VARSIZE_ANY_EXHDR(url), method, body ? VARDATA_ANY(body) : NULL, body ? VARSIZE_ANY_EXHDR(body) : 0, headers && !header_nulls[i] ? DatumGetJsonb(headers[i]) : NULL);
+#endif
+            if (method) pfree(method);
+#if PG_VERSION_NUM >= 100000
+            if (pg_curl_breaker_reject(curl)) continue; // its row reports the open breaker, other urls of the batch go on
+#endif
+            pg_curl_multi_add_handle_admitted(curl);
+        }
+        pg_curl_multi_perform_my(try, sleep, timeout_ms, pg_curl_multi_batch_done, &batch);
+    } PG_CATCH(); {
+        pg_curl_multi_batch_cleanup(&batch, context);
+        PG_RE_THROW();
+    } PG_END_TRY();
+    pg_curl_multi_batch_cleanup(&batch, context);
+    return (Datum)0;
+}
+
+static Datum pg_curl_share_setopt(PG_FUNCTION_ARGS, CURLSHoption option) {
+    CURLSHcode sc = CURLSHE_OK;
+    long parameter;
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_share_setopt_* requires argument parameter")));
+    if ((parameter = PG_GETARG_INT64(0)) <= CURL_LOCK_DATA_SHARE || parameter >= CURL_LOCK_DATA_LAST) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_share_setopt_* invalid argument parameter %li", parameter)));
+    if (pg_curl.share && (sc = curl_share_setopt(pg_curl.share, option, (curl_lock_data)parameter)) != CURLSHE_OK) ereport(ERROR, (pg_curl_sc(sc), errmsg("%s", curl_share_strerror(sc))));
+    if (option == CURLSHOPT_SHARE) pg_curl.share_data |= 1L << parameter; else pg_curl.share_data &= ~(1L << parameter);
+    PG_RETURN_BOOL(sc == CURLSHE_OK);
+}
+
+EXTENSION(pg_curl_share_setopt_share) { return pg_curl_share_setopt(fcinfo, CURLSHOPT_SHARE); }
+EXTENSION(pg_curl_share_setopt_unshare) { return pg_curl_share_setopt(fcinfo, CURLSHOPT_UNSHARE); }
+
+static Datum pg_curl_multi_setopt_long(PG_FUNCTION_ARGS, CURLMoption option) {
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_multi_setopt_* requires argument parameter")));
+    pg_curl_multi_init();
+    pg_curl_multi_setopt_my(option, PG_GETARG_INT64(0));
+    PG_RETURN_BOOL(true);
+}
+
+EXTENSION(pg_curl_multi_setopt_max_concurrent_streams) {
+#if CURL_AT_LEAST_VERSION(7, 67, 0)
+    return pg_curl_multi_setopt_long(fcinfo, CURLMOPT_MAX_CONCURRENT_STREAMS);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_multi_setopt_max_concurrent_streams requires curl 7.67.0 or later")));
+#endif
+}
+EXTENSION(pg_curl_multi_setopt_max_host_connections) {
+#if CURL_AT_LEAST_VERSION(7, 30, 0)
+    return pg_curl_multi_setopt_long(fcinfo, CURLMOPT_MAX_HOST_CONNECTIONS);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_multi_setopt_max_host_connections requires curl 7.30.0 or later")));
+#endif
+}
+EXTENSION(pg_curl_multi_setopt_max_total_connections) {
+#if CURL_AT_LEAST_VERSION(7, 30, 0)
+    return pg_curl_multi_setopt_long(fcinfo, CURLMOPT_MAX_TOTAL_CONNECTIONS);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_multi_setopt_max_total_connections requires curl 7.30.0 or later")));
+#endif
+}
+EXTENSION(pg_curl_multi_setopt_maxconnects) {
+#if CURL_AT_LEAST_VERSION(7, 16, 3)
+    return pg_curl_multi_setopt_long(fcinfo, CURLMOPT_MAXCONNECTS);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_multi_setopt_maxconnects requires curl 7.16.3 or later")));
+#endif
+}
+EXTENSION(pg_curl_multi_setopt_pipelining) {
+#if CURL_AT_LEAST_VERSION(7, 43, 0)
+    return pg_curl_multi_setopt_long(fcinfo, CURLMOPT_PIPELINING);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_multi_setopt_pipelining requires curl 7.43.0 or later")));
+#endif
+}
+
+EXTENSION(pg_curl_share_cleanup) {
+    CURLSHcode sc = CURLSHE_OK;
+    if (pg_curl.share && (sc = curl_share_cleanup(pg_curl.share)) == CURLSHE_IN_USE && pg_curl.hash) { // handles keep the share from prepare until removed from multi, so detach idle ones and try again
+        HASH_SEQ_STATUS status;
+        pg_curl_hash_t *hash;
+        hash_seq_init(&status, pg_curl.hash);
+        while ((hash = hash_seq_search(&status))) if (hash->curl->easy && !hash->curl->multi) {
+            CURLcode ec;
+            if ((ec = curl_easy_setopt(hash->curl->easy, CURLOPT_SHARE, NULL)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+            hash->curl->reserved = false; // waiting handle is prepared again with new share
+        }
+        sc = curl_share_cleanup(pg_curl.share);
+    }
+    if (sc != CURLSHE_OK) ereport(ERROR, (pg_curl_sc(sc), errmsg("%s", curl_share_strerror(sc)), errhint("Perform or remove handles of multi first.")));
+    pg_curl.share = NULL;
+    PG_RETURN_BOOL(sc == CURLSHE_OK);
+}
+
+EXTENSION(pg_curl_global_memory) {
+    bool locking = pg_curl_locking();
+    bool nulls[5] = {false};
+    Datum values[5];
+    TupleDesc tupdesc;
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("return type must be a row type")));
+    if (locking) pthread_mutex_lock(&pg_curl.mutex);
+    values[0] = Int64GetDatum(pg_curl.memory.allocations);
+    values[1] = Int64GetDatum(pg_curl.memory.frees);
+    values[2] = Int64GetDatum(pg_curl.memory.reallocations);
+#if PG_VERSION_NUM >= 130000
+    values[3] = Int64GetDatum(pg_curl.global ? MemoryContextMemAllocated(pg_curl.global, true) : 0);
+#else
+    nulls[3] = true;
+#endif
+    if (locking) pthread_mutex_unlock(&pg_curl.mutex);
+    values[4] = BoolGetDatum(pg_curl.threaded);
+    PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls)));
+}
+
+EXTENSION(pg_curl_global_aborted) {
+    bool nulls[2] = {false};
+    Datum values[2];
+    TupleDesc tupdesc;
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("return type must be a row type")));
+    values[0] = Int64GetDatum(pg_curl.aborted.header);
+    values[1] = Int64GetDatum(pg_curl.aborted.response);
+    PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls)));
+}
+
+EXTENSION(pg_curl_breaker_state) {
+#if PG_VERSION_NUM >= 100000
+    HASH_SEQ_STATUS status;
+    pg_curl_breaker_t *breaker;
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore = pg_curl_tuplestore(fcinfo, &tupdesc);
+    if (!pg_curl_breaker.hash) return (Datum)0;
+    LWLockAcquire(pg_curl_breaker.lock, LW_SHARED);
+    hash_seq_init(&status, pg_curl_breaker.hash);
+    while ((breaker = hash_seq_search(&status))) {
+        bool nulls[7] = {false, false, false, false, false, !breaker->opened, false};
+        Datum values[7] = {
+            CStringGetTextDatum(breaker->host),
+            CStringGetTextDatum(breaker->state == 'o' ? "open" : breaker->state == 'h' ? "half-open" : "closed"),
+            Int64GetDatum(breaker->requests),
+            Int64GetDatum(breaker->failures),
+            Int64GetDatum(breaker->rejected),
+            TimestampTzGetDatum(breaker->opened),
+            TimestampTzGetDatum(breaker->window),
+        };
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    LWLockRelease(pg_curl_breaker.lock);
+    return (Datum)0;
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_breaker_state requires PostgreSQL 10 or later")));
+#endif
+}
+
+EXTENSION(pg_curl_rate_limit_state) {
+#if PG_VERSION_NUM >= 100000
+    HASH_SEQ_STATUS status;
+    pg_curl_limit_t *limit;
+    TimestampTz now = GetCurrentTimestamp();
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore = pg_curl_tuplestore(fcinfo, &tupdesc);
+    if (!pg_curl_limit.hash) return (Datum)0;
+    LWLockAcquire(pg_curl_limit.lock, LW_SHARED);
+    hash_seq_init(&status, pg_curl_limit.hash);
+    while ((limit = hash_seq_search(&status))) {
+        bool nulls[7] = {false};
+        Datum values[7] = {
+            CStringGetTextDatum(limit->host),
+            Float8GetDatum(limit->rate),
+            Float8GetDatum(limit->burst),
+            Float8GetDatum(now > limit->updated ? Min(limit->burst, limit->tokens + limit->rate * (now - limit->updated) / USECS_PER_SEC) : limit->tokens),
+            Int64GetDatum(limit->granted),
+            Int64GetDatum(limit->delayed),
+            TimestampTzGetDatum(limit->updated),
+        };
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    LWLockRelease(pg_curl_limit.lock);
+    return (Datum)0;
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_rate_limit_state requires PostgreSQL 10 or later")));
+#endif
+}
+
+#if PG_VERSION_NUM >= 100000
+#define PG_CURL_WORKER_MQ_SIZE 65536
+
+typedef struct {
+    bool isnull[4];
+    int timeout_ms;
+    Size len[4];
+    Size mq;
+} pg_curl_worker_message_t;
+
+typedef struct {
+    double total_time;
+    int64 errcode;
+    int64 response_code;
+    int sqlerrcode; // worker failed to start the request, errbuf holds the message
+    Size len[3];
+} pg_curl_worker_reply_t;
+
+typedef struct {
+    pg_curl_t curl; // always first, because easy cleanup frees it
+    dsm_segment *seg; // NULL for asynchronous requests
+    int64 id;
+    int attempt;
+    int try;
+    long sleep;
+    MemoryContext context;
+    pg_curl_worker_reply_t reply;
+    shm_mq_handle *mqh;
+    shm_mq_iovec iov[4];
+    TimestampTz retry;
+} pg_curl_worker_request_t;
+
+typedef struct {
+    bool wakeup;
+    int head;
+    int size;
+    int tail;
+    bool connecting; // worker died while connecting, when still set at its start
+    Latch *latch;
+    uint64 generation; // counts worker starts, so that requesters notice a restart
+
+    slock_t mutex;
+    dsm_handle queue[FLEXIBLE_ARRAY_MEMBER];
+} pg_curl_worker_shmem_t;
+
+static struct {
+    bool failed;
+    bool queue; // connected to pg_curl.worker_database
+    bool reset;
+    bool wakeup;
+    char *database;
+    int async;
+    int async_limit;
+    int max_host_connections;
+    int max_total_connections;
+    int naptime;
+    int queue_size;
+    List *finished;
+    List *pending;
+    List *retry;
+    pg_curl_worker_shmem_t *shmem;
+    TimestampTz fetch;
+#if PG_VERSION_NUM >= 150000
+    shmem_request_hook_type shmem_request_hook;
+#endif
+    shmem_startup_hook_type shmem_startup_hook;
+    volatile sig_atomic_t sighup;
+} pg_curl_worker = {
+    .async_limit = 100,
+    .naptime = 1000,
+    .queue_size = 1024,
+};
+
+static Size pg_curl_worker_shmem_size(void) {
+    return add_size(offsetof(pg_curl_worker_shmem_t, queue), mul_size(pg_curl_worker.queue_size + 1, sizeof(dsm_handle)));
+}
+
+#if PG_VERSION_NUM >= 150000
+static void pg_curl_worker_shmem_request(void) {
+    if (pg_curl_worker.shmem_request_hook) pg_curl_worker.shmem_request_hook();
+    RequestAddinShmemSpace(pg_curl_worker_shmem_size());
+    RequestAddinShmemSpace(pg_curl_limit_shmem_size());
+    RequestNamedLWLockTranche("pg_curl limit", 1);
+    RequestAddinShmemSpace(pg_curl_breaker_shmem_size());
+    RequestNamedLWLockTranche("pg_curl breaker", 1);
+}
+#endif
+
+static void pg_curl_worker_shmem_startup(void) {
+    bool found;
+    if (pg_curl_worker.shmem_startup_hook) pg_curl_worker.shmem_startup_hook();
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+    pg_curl_worker.shmem = ShmemInitStruct("pg_curl worker", pg_curl_worker_shmem_size(), &found);
+    if (!found) {
+        MemSet(pg_curl_worker.shmem, 0, pg_curl_worker_shmem_size());
+        pg_curl_worker.shmem->size = pg_curl_worker.queue_size + 1;
+        SpinLockInit(&pg_curl_worker.shmem->mutex);
+    }
+    pg_curl_limit_shmem_startup();
+    pg_curl_breaker_shmem_startup();
+    LWLockRelease(AddinShmemInitLock);
+}
+
+static void pg_curl_worker_shmem_exit(int code, Datum arg) {
+    SpinLockAcquire(&pg_curl_worker.shmem->mutex);
+    pg_curl_worker.shmem->latch = NULL;
+    SpinLockRelease(&pg_curl_worker.shmem->mutex);
+}
+
+static uint64 pg_curl_worker_enqueue(dsm_handle handle) {
+    int tail;
+    uint64 generation;
+    Latch *latch;
+    pg_curl_worker_shmem_t *shmem = pg_curl_worker.shmem;
+    SpinLockAcquire(&shmem->mutex);
+    if (!(latch = shmem->latch)) {
+        SpinLockRelease(&shmem->mutex);
+        ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE), errmsg("pg_curl worker is not running")));
+    }
+    if ((tail = (shmem->tail + 1) % shmem->size) == shmem->head) {
+        SpinLockRelease(&shmem->mutex);
+        ereport(ERROR, (errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED), errmsg("pg_curl worker queue is full"), errhint("Increase pg_curl.worker_queue_size.")));
+    }
+    shmem->queue[shmem->tail] = handle;
+    shmem->tail = tail;
+    generation = shmem->generation;
+    SpinLockRelease(&shmem->mutex);
+    SetLatch(latch);
+    return generation;
+}
+
+static bool pg_curl_worker_alive(uint64 generation) {
+    bool alive;
+    SpinLockAcquire(&pg_curl_worker.shmem->mutex);
+    alive = pg_curl_worker.shmem->latch && pg_curl_worker.shmem->generation == generation;
+    SpinLockRelease(&pg_curl_worker.shmem->mutex);
+    return alive;
+}
+
+static pg_curl_worker_request_t *pg_curl_worker_request(void) {
+    MemoryContext context = AllocSetContextCreate(TopMemoryContext, "pg_curl worker request", ALLOCSET_DEFAULT_SIZES);
+    pg_curl_worker_request_t *request = MemoryContextAllocZero(context, sizeof(*request));
+    request->context = context;
+    pg_curl_easy_init_my(&request->curl, context);
+    return request;
+}
+
+static void pg_curl_worker_timeout(pg_curl_worker_request_t *request, int timeout_ms) {
+    CURLcode ec;
+    if (timeout_ms > 0 && (ec = curl_easy_setopt(request->curl.easy, CURLOPT_TIMEOUT_MS, (long)timeout_ms)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+}
+
+static void pg_curl_worker_reply(pg_curl_worker_request_t *request) {
+    pg_curl_t *curl = &request->curl;
+    MemoryContext oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+    request->iov[0] = (shm_mq_iovec){.data = (const char *)&request->reply, .len = sizeof(request->reply)};
+    request->iov[1] = (shm_mq_iovec){.data = curl->errbuf, .len = request->reply.len[0]};
+    request->iov[2] = (shm_mq_iovec){.data = PG_CURL_VARLENA_DATA(&curl->header_in), .len = request->reply.len[1]};
+    request->iov[3] = (shm_mq_iovec){.data = PG_CURL_VARLENA_DATA(&curl->data_in), .len = request->reply.len[2]};
+    pg_curl_worker.pending = lappend(pg_curl_worker.pending, request);
+    MemoryContextSwitchTo(oldMemoryContext);
+}
+
+static void pg_curl_worker_fail(pg_curl_worker_request_t *request, ErrorData *edata) { // one bad request must not take down the worker with the requests of others, so it is finished with its error
+    MemoryContext oldMemoryContext;
+    pg_curl_multi_remove_handle(&request->curl, false);
+    pg_curl_varlena_reset(&request->curl.data_in);
+    pg_curl_varlena_reset(&request->curl.header_in);
+    strlcpy(request->curl.errbuf, edata->message, sizeof(request->curl.errbuf));
+    request->reply.errcode = CURLE_FAILED_INIT;
+    request->reply.response_code = 0;
+    request->reply.total_time = 0;
+    if (request->seg) {
+        request->reply.sqlerrcode = edata->sqlerrcode;
+        request->reply.len[0] = strlen(request->curl.errbuf);
+        request->reply.len[1] = 0;
+        request->reply.len[2] = 0;
+        pg_curl_worker_reply(request);
+        return;
+    }
+    oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+    pg_curl_worker.finished = lappend(pg_curl_worker.finished, request);
+    MemoryContextSwitchTo(oldMemoryContext);
+}
+
+static void pg_curl_worker_attach(dsm_handle handle) {
+    char *data;
+    char *method = NULL;
+    dsm_segment *seg;
+    Jsonb *headers = NULL;
+    MemoryContext oldMemoryContext;
+    pg_curl_worker_message_t *message;
+    pg_curl_worker_request_t *request;
+    shm_mq *mq;
+    if (!(seg = dsm_attach(handle))) return; // requester has already gone away
+    message = dsm_segment_address(seg);
+    mq = (shm_mq *)((char *)message + message->mq);
+    PG_TRY(); {
+        request = pg_curl_worker_request();
+    } PG_CATCH(); {
+        dsm_detach(seg); // requester sees the worker never attached
+        PG_RE_THROW();
+    } PG_END_TRY();
+    oldMemoryContext = MemoryContextSwitchTo(request->context);
+    request->seg = seg;
+    shm_mq_set_sender(mq, MyProc);
+    request->mqh = shm_mq_attach(mq, seg, NULL);
+    MemoryContextSwitchTo(oldMemoryContext);
+    PG_TRY(); {
+        MemoryContextSwitchTo(request->context);
+        data = (char *)message + MAXALIGN(sizeof(*message));
+        if (!message->isnull[1]) method = pnstrdup(data + MAXALIGN(message->len[0]), message->len[1]);
+        if (!message->isnull[3]) headers = memcpy(palloc(message->len[3]), data + MAXALIGN(message->len[0]) + MAXALIGN(message->len[1]) + MAXALIGN(message->len[2]), message->len[3]);
+        pg_curl_easy_request_my(&request->curl, data, message->len[0], method, message->isnull[2] ? NULL : data + MAXALIGN(message->len[0]) + MAXALIGN(message->len[1]), message->len[2], headers);
+        pg_curl_worker_timeout(request, message->timeout_ms);
+        MemoryContextSwitchTo(oldMemoryContext);
+        pg_curl_multi_add_handle_my(&request->curl);
+    } PG_CATCH(); {
+        ErrorData *edata;
+        MemoryContextSwitchTo(oldMemoryContext);
+        edata = CopyErrorData();
+        FlushErrorState();
+        pg_curl_worker_fail(request, edata);
+        FreeErrorData(edata);
+    } PG_END_TRY();
+}
+
+static void pg_curl_worker_dequeue(void) {
+    pg_curl_worker_shmem_t *shmem = pg_curl_worker.shmem;
+    for (;;) {
+        dsm_handle handle;
+        SpinLockAcquire(&shmem->mutex);
+        if (shmem->head == shmem->tail) {
+            SpinLockRelease(&shmem->mutex);
+            break;
+        }
+        handle = shmem->queue[shmem->head];
+        shmem->head = (shmem->head + 1) % shmem->size;
+        SpinLockRelease(&shmem->mutex);
+        pg_curl_worker_attach(handle);
+    }
+}
+
+static void pg_curl_worker_done(pg_curl_t *curl, void *arg) {
+    CURLcode ec;
+    long response_code = 0;
+    MemoryContext oldMemoryContext;
+    pg_curl_worker_request_t *request = (pg_curl_worker_request_t *)curl;
+    if ((ec = curl_easy_getinfo(curl->easy, CURLINFO_RESPONSE_CODE, &response_code)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    request->reply.errcode = curl->errcode;
+    request->reply.response_code = response_code;
+    request->reply.total_time = pg_curl_easy_getinfo_double_my(curl, CURLINFO_TOTAL_TIME);
+    request->reply.len[0] = strlen(curl->errbuf);
+    request->reply.len[1] = PG_CURL_VARLENA_LEN(&curl->header_in);
+    request->reply.len[2] = PG_CURL_VARLENA_LEN(&curl->data_in);
+    oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+    if (!request->seg) {
+        if (!pg_curl_easy_permanent(curl->errcode) && ++request->attempt < request->try) {
+            pg_curl_easy_warning(curl, request->attempt);
+            request->retry = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), request->sleep / 1000);
+            pg_curl_worker.retry = lappend(pg_curl_worker.retry, request);
+        } else pg_curl_worker.finished = lappend(pg_curl_worker.finished, request);
+        MemoryContextSwitchTo(oldMemoryContext);
+        return;
+    }
+    MemoryContextSwitchTo(oldMemoryContext);
+    pg_curl_worker_reply(request);
+}
+
+static void pg_curl_worker_flush(void) {
+    ListCell *lc;
+    List *pending = NIL;
+    MemoryContext oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+    foreach (lc, pg_curl_worker.pending) {
+        pg_curl_worker_request_t *request = lfirst(lc);
+#if PG_VERSION_NUM >= 150000
+        if (shm_mq_sendv(request->mqh, request->iov, lengthof(request->iov), true, true) == SHM_MQ_WOULD_BLOCK) {
+#else
+        if (shm_mq_sendv(request->mqh, request->iov, lengthof(request->iov), true) == SHM_MQ_WOULD_BLOCK) {
+#endif
+            pending = lappend(pending, request);
+            continue;
+        }
+        dsm_detach(request->seg);
+        MemoryContextDelete(request->context);
+    }
+    list_free(pg_curl_worker.pending);
+    pg_curl_worker.pending = pending;
+    MemoryContextSwitchTo(oldMemoryContext);
+}
+
+static void pg_curl_worker_setopt(void) {
+#if CURL_AT_LEAST_VERSION(7, 30, 0)
+    pg_curl_multi_setopt_my(CURLMOPT_MAX_HOST_CONNECTIONS, pg_curl_worker.max_host_connections);
+    pg_curl_multi_setopt_my(CURLMOPT_MAX_TOTAL_CONNECTIONS, pg_curl_worker.max_total_connections);
+#endif
+}
+
+static long pg_curl_worker_interval(TimestampTz start, TimestampTz stop) {
+    long secs;
+    int usecs;
+    TimestampDifference(start, stop, &secs, &usecs);
+    return secs * 1000 + usecs / 1000;
+}
+
+static pg_curl_worker_request_t *pg_curl_worker_async_attach(HeapTuple tuple, TupleDesc tupdesc) {
+    bool isnull;
+    bytea *body;
+    char *method;
+    Datum datum;
+    Jsonb *headers;
+    MemoryContext oldMemoryContext;
+    pg_curl_worker_request_t *request = pg_curl_worker_request();
+    text *url;
+    oldMemoryContext = MemoryContextSwitchTo(request->context);
+    request->id = DatumGetInt64(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+    url = DatumGetTextPP(SPI_getbinval(tuple, tupdesc, 2, &isnull));
+    datum = SPI_getbinval(tuple, tupdesc, 3, &isnull);
+    method = isnull ? NULL : TextDatumGetCString(datum);
+    datum = SPI_getbinval(tuple, tupdesc, 4, &isnull);
+    body = isnull ? NULL : DatumGetByteaPP(datum);
+    datum = SPI_getbinval(tuple, tupdesc, 5, &isnull);
+#if PG_VERSION_NUM >= 110000
+    headers = isnull ? NULL : DatumGetJsonbP(datum);
+#else
+    headers = isnull ? NULL : DatumGetJsonb(datum);
+#endif
+    request->try = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 6, &isnull));
+    request->sleep = DatumGetInt64(SPI_getbinval(tuple, tupdesc, 7, &isnull));
+    pg_curl_easy_request_my(&request->curl, VARDATA_ANY(url), VARSIZE_ANY_EXHDR(url), method, body ? VARDATA_ANY(body) : NULL, body ? VARSIZE_ANY_EXHDR(body) : 0, headers);
+    pg_curl_worker_timeout(request, DatumGetInt32(SPI_getbinval(tuple, tupdesc, 8, &isnull)));
+    MemoryContextSwitchTo(oldMemoryContext);
+    return request;
+}
+
+static void pg_curl_worker_async_add(pg_curl_worker_request_t *request) { // request which can not start is finished with its error, so that it is not claimed again
+    MemoryContext oldMemoryContext = CurrentMemoryContext;
+    PG_TRY(); {
+        pg_curl_multi_add_handle_my(&request->curl);
+    } PG_CATCH(); {
+        ErrorData *edata;
+        MemoryContextSwitchTo(oldMemoryContext);
+        edata = CopyErrorData();
+        FlushErrorState();
+        pg_curl_worker_fail(request, edata);
+        FreeErrorData(edata);
+    } PG_END_TRY();
+}
+
+static void pg_curl_worker_async_store(const char *schema) {
+    ListCell *lc;
+    SPIPlanPtr plan;
+    StringInfoData buf;
+    initStringInfo(&buf);
+    appendStringInfo(&buf, "UPDATE %s.curl_async SET finished = now(), errcode = $2, errbuf = $3, response_code = $4, header_in = $5, data_in = $6, total_time = $7 WHERE id = $1", schema);
+    if (!(plan = SPI_prepare(buf.data, 7, (Oid []){INT8OID, INT8OID, TEXTOID, INT8OID, TEXTOID, BYTEAOID, FLOAT8OID}))) ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("SPI_prepare failed: %s", SPI_result_code_string(SPI_result))));
+    foreach (lc, pg_curl_worker.finished) {
+        pg_curl_worker_request_t *request = lfirst(lc);
+        pg_curl_t *curl = &request->curl;
+        char nulls[7] = {' ', ' ', curl->errbuf[0] ? ' ' : 'n', ' ', PG_CURL_VARLENA_LEN(&curl->header_in) ? ' ' : 'n', PG_CURL_VARLENA_LEN(&curl->data_in) ? ' ' : 'n', ' '};
+        Datum values[7] = {
+            Int64GetDatum(request->id),
+            Int64GetDatum(request->reply.errcode),
+            curl->errbuf[0] ? CStringGetTextDatum(curl->errbuf) : (Datum)0,
+            Int64GetDatum(request->reply.response_code),
+            PG_CURL_VARLENA_LEN(&curl->header_in) ? pg_curl_varlena(&curl->header_in) : (Datum)0,
+            PG_CURL_VARLENA_LEN(&curl->data_in) ? pg_curl_varlena(&curl->data_in) : (Datum)0,
+            Float8GetDatum(request->reply.total_time),
+        };
+        if (SPI_execute_plan(plan, values, nulls, false, 0) != SPI_OK_UPDATE) ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("SPI_execute_plan failed")));
+    }
+}
+
+static bool pg_curl_worker_async_transaction(void) { // failed transaction keeps finished requests for the next try and drops claimed ones, which it did not claim after all
+    bool reset = pg_curl_worker.reset;
+    List *volatile claimed = NIL;
+    ListCell *lc;
+    List *list;
+    MemoryContext oldMemoryContext = CurrentMemoryContext;
+    volatile bool success = true;
+    SetCurrentStatementStartTimestamp();
+    StartTransactionCommand();
+    PG_TRY(); {
+        Oid extension;
+        const char *schema = NULL;
+        SPI_connect();
+        PushActiveSnapshot(GetTransactionSnapshot());
+        pgstat_report_activity(STATE_RUNNING, "pg_curl worker");
+        if (OidIsValid(extension = get_extension_oid("pg_curl", true))) schema = quote_identifier(get_namespace_name(get_extension_schema(extension)));
+        if (schema) {
+            StringInfoData buf;
+            pg_curl_worker_async_store(schema);
+            initStringInfo(&buf);
+            if (!pg_curl_worker.reset) { // requests claimed by a previous incarnation of the worker are lost, so claim them again
+                appendStringInfo(&buf, "UPDATE %s.curl_async SET started = NULL WHERE started IS NOT NULL AND finished IS NULL", schema);
+                if (SPI_execute(buf.data, false, 0) != SPI_OK_UPDATE) ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("SPI_execute failed")));
+                pg_curl_worker.reset = true;
+                resetStringInfo(&buf);
+            }
+            if (pg_curl_worker.async < pg_curl_worker.async_limit) {
+                appendStringInfo(&buf, "UPDATE %1$s.curl_async SET started = now() WHERE id IN (SELECT id FROM %1$s.curl_async WHERE started IS NULL ORDER BY id LIMIT $1 FOR UPDATE SKIP LOCKED) RETURNING id, url, method, body, headers, try, sleep, timeout_ms", schema);
+                if (SPI_execute_with_args(buf.data, 1, (Oid []){INT4OID}, (Datum []){Int32GetDatum(pg_curl_worker.async_limit - pg_curl_worker.async)}, NULL, false, 0) != SPI_OK_UPDATE_RETURNING) ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("SPI_execute_with_args failed")));
+                for (uint64 row = 0; row < SPI_processed; row++) {
+                    pg_curl_worker_request_t *request = pg_curl_worker_async_attach(SPI_tuptable->vals[row], SPI_tuptable->tupdesc);
+                    MemoryContext spiMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+                    claimed = lappend(claimed, request);
+                    MemoryContextSwitchTo(spiMemoryContext);
+                }
+            }
+        }
+        SPI_finish();
+        PopActiveSnapshot();
+        CommitTransactionCommand();
+    } PG_CATCH(); {
+        MemoryContextSwitchTo(oldMemoryContext);
+        EmitErrorReport();
+        FlushErrorState();
+        AbortCurrentTransaction();
+        pg_curl_worker.reset = reset;
+        success = false;
+    } PG_END_TRY();
+    pgstat_report_activity(STATE_IDLE, NULL);
+    MemoryContextSwitchTo(oldMemoryContext);
+    list = claimed;
+    if (!success) {
+        foreach (lc, list) MemoryContextDelete(((pg_curl_worker_request_t *)lfirst(lc))->context);
+        list_free(list);
+        return false;
+    }
+    foreach (lc, pg_curl_worker.finished) {
+        MemoryContextDelete(((pg_curl_worker_request_t *)lfirst(lc))->context);
+        pg_curl_worker.async--;
+    }
+    list_free(pg_curl_worker.finished);
+    pg_curl_worker.finished = NIL;
+    foreach (lc, list) { // only committed claims are performed, so that a rolled back claim is never performed twice
+        pg_curl_worker.async++;
+        pg_curl_worker_async_add(lfirst(lc));
+    }
+    list_free(list);
+    return true;
+}
+
+static long pg_curl_worker_async(void) {
+    bool wakeup;
+    ListCell *lc;
+    List *retry = NIL;
+    long timeout;
+    MemoryContext oldMemoryContext = MemoryContextSwitchTo(TopMemoryContext);
+    TimestampTz now = GetCurrentTimestamp();
+    foreach (lc, pg_curl_worker.retry) {
+        pg_curl_worker_request_t *request = lfirst(lc);
+        if (request->retry <= now) pg_curl_worker_async_add(request);
+        else retry = lappend(retry, request);
+    }
+    list_free(pg_curl_worker.retry);
+    pg_curl_worker.retry = retry;
+    MemoryContextSwitchTo(oldMemoryContext);
+    SpinLockAcquire(&pg_curl_worker.shmem->mutex);
+    wakeup = pg_curl_worker.shmem->wakeup;
+    pg_curl_worker.shmem->wakeup = false;
+    SpinLockRelease(&pg_curl_worker.shmem->mutex);
+    if (pg_curl_worker.queue && (wakeup || (pg_curl_worker.finished && !pg_curl_worker.failed) || now >= pg_curl_worker.fetch)) { // after failure wait for naptime
+        pg_curl_worker.failed = !pg_curl_worker_async_transaction();
+        pg_curl_worker.fetch = TimestampTzPlusMilliseconds(now, pg_curl_worker.naptime);
+    }
+    timeout = pg_curl_worker_interval(now, pg_curl_worker.fetch);
+    foreach (lc, pg_curl_worker.retry) timeout = Min(timeout, pg_curl_worker_interval(now, ((pg_curl_worker_request_t *)lfirst(lc))->retry));
+    return pg_curl_multi_retry_my(timeout); // requests waiting for rate limit tokens
+}
+
+static void pg_curl_worker_xact_callback(XactEvent event, void *arg) {
+    Latch *latch = NULL;
+    switch (event) {
+        case XACT_EVENT_COMMIT:
+            if (pg_curl_worker.wakeup && pg_curl_worker.shmem) {
+                SpinLockAcquire(&pg_curl_worker.shmem->mutex);
+                pg_curl_worker.shmem->wakeup = true;
+                latch = pg_curl_worker.shmem->latch;
+                SpinLockRelease(&pg_curl_worker.shmem->mutex);
+                if (latch) SetLatch(latch);
+            } // fall through
+        case XACT_EVENT_ABORT: pg_curl_worker.wakeup = false; break;
+        default: break;
+    }
+}
+
+static void pg_curl_worker_sighup(SIGNAL_ARGS) {
+    int save_errno = errno;
+    pg_curl_worker.sighup = true;
+    SetLatch(MyLatch);
+    errno = save_errno;
+}
+
+PGDLLEXPORT void pg_curl_worker_main(Datum main_arg);
+void pg_curl_worker_main(Datum main_arg) {
+    bool connecting;
+    pg_curl_multi_state_t state = {.ec = CURL_LAST, .try = 1};
+    pqsignal(SIGHUP, pg_curl_worker_sighup);
+    pqsignal(SIGTERM, die);
+    BackgroundWorkerUnblockSignals();
+    SpinLockAcquire(&pg_curl_worker.shmem->mutex);
+    connecting = pg_curl_worker.shmem->connecting;
+    pg_curl_worker.shmem->connecting = true;
+    SpinLockRelease(&pg_curl_worker.shmem->mutex);
+    if (connecting) { // missing database is fatal, so connect to none instead of dying on every restart, curl_worker_perform needs no database
+        ereport(WARNING, (errcode(ERRCODE_UNDEFINED_DATABASE), errmsg("pg_curl worker could not connect to database \"%s\", curl_async is not served", pg_curl_worker.database), errhint("Create the database or change pg_curl.worker_database, then restart the server.")));
+#if PG_VERSION_NUM >= 110000
+        BackgroundWorkerInitializeConnection(NULL, NULL, 0);
+#else
+        BackgroundWorkerInitializeConnection(NULL, NULL);
+#endif
+    } else {
+#if PG_VERSION_NUM >= 110000
+        BackgroundWorkerInitializeConnection(pg_curl_worker.database, NULL, 0);
+#else
+        BackgroundWorkerInitializeConnection(pg_curl_worker.database, NULL);
+#endif
+        pg_curl_worker.queue = true;
+    }
+    SpinLockAcquire(&pg_curl_worker.shmem->mutex);
+    pg_curl_worker.shmem->connecting = false;
+    SpinLockRelease(&pg_curl_worker.shmem->mutex);
+    pg_curl.transaction = false;
+    pg_curl_multi_init();
+    pg_curl_worker_setopt();
+    on_shmem_exit(pg_curl_worker_shmem_exit, (Datum)0);
+    SpinLockAcquire(&pg_curl_worker.shmem->mutex);
+    pg_curl_worker.shmem->generation++;
+    pg_curl_worker.shmem->latch = MyLatch;
+    SpinLockRelease(&pg_curl_worker.shmem->mutex);
+    for (;;) {
+        MemoryContext oldMemoryContext = CurrentMemoryContext;
         CHECK_FOR_INTERRUPTS();
-        if ((mc = curl_multi_wait(pg_curl.multi, NULL, 0, timeout_ms, NULL)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
-        if ((mc = curl_multi_perform(pg_curl.multi, &running_handles)) != CURLM_OK) ereport(ERROR, (pg_curl_mc(mc), errmsg("%s", curl_multi_strerror(mc))));
-        while ((msg = curl_multi_info_read(pg_curl.multi, &msgs_in_queue))) if (msg->msg == CURLMSG_DONE) {
+        if (pg_curl_worker.sighup) {
+            pg_curl_worker.sighup = false;
+            ProcessConfigFile(PGC_SIGHUP);
+            pg_curl_worker_setopt();
+        }
+        PG_TRY(); { // restarted worker claims the unfinished rows again, so an error must not take it down with the requests in flight
             pg_curl_t *curl;
-            if ((ec = curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
-            curl->errcode = msg->data.result;
-            curl->try++;
-            switch ((ec = curl->errcode)) {
-                case CURLE_ABORTED_BY_CALLBACK: break;
-                case CURLE_OK: curl->try = try; break;
-                case CURLE_UNSUPPORTED_PROTOCOL: case CURLE_FAILED_INIT: case CURLE_URL_MALFORMAT: case CURLE_NOT_BUILT_IN: case CURLE_FUNCTION_NOT_FOUND: case CURLE_BAD_FUNCTION_ARGUMENT: case CURLE_UNKNOWN_OPTION: case CURLE_LDAP_INVALID_URL: curl->try = try; // fall through
-                default: if (curl->try < try) {
-                    if (curl->errbuf[0]) ereport(WARNING, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec)), errdetail("%s", curl->errbuf), errcontext("try %i", curl->try)));
-                    else ereport(WARNING, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec)), errcontext("try %i", curl->try)));
-                    sleep_need = true;
-                }
+            pg_curl_worker_dequeue();
+            pg_curl_worker_flush();
+            pg_curl_multi_socket_wait(&state, pg_curl_worker_async());
+            while ((curl = pg_curl_multi_info_read_my(&state))) {
+                pg_curl_worker_done(curl, NULL);
+                pg_curl.current = NULL;
             }
-            if (curl->try < try) running_handles++; else pg_curl_multi_remove_handle(curl, true);
-        }
-        if (sleep_need && sleep) pg_usleep(sleep);
-    } while (running_handles);
-    PG_RETURN_BOOL(ec == CURLE_OK && mc == CURLM_OK);
+        } PG_CATCH(); {
+            ErrorData *edata;
+            pg_curl_t *curl = pg_curl.current;
+            MemoryContextSwitchTo(oldMemoryContext);
+            edata = CopyErrorData();
+            FlushErrorState();
+            pg_curl.current = NULL;
+            if (curl) pg_curl_worker_fail((pg_curl_worker_request_t *)curl, edata);
+            else ereport(WARNING, (errcode(edata->sqlerrcode), errmsg("pg_curl worker loop failed: %s", edata->message)));
+            FreeErrorData(edata);
+        } PG_END_TRY();
+    }
 }
+#endif
 
-EXTENSION(pg_curl_easy_perform) {
-    return pg_curl_multi_add_handle_my("unknown") && pg_curl_multi_perform(fcinfo);
+EXTENSION(pg_curl_worker_perform) {
+#if PG_VERSION_NUM >= 100000
+    bool nulls[6] = {false};
+    char *data;
+    Datum values[6];
+    dsm_segment *seg;
+    pg_curl_worker_message_t *message;
+    pg_curl_worker_reply_t reply;
+    shm_mq *mq;
+    shm_mq_handle *mqh;
+    Size len;
+    Size offset = MAXALIGN(sizeof(*message));
+    struct varlena *args[4] = {NULL};
+    TupleDesc tupdesc;
+    uint64 generation;
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_worker_perform requires argument url")));
+    if (!pg_curl_worker.shmem) ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE), errmsg("pg_curl worker is not available"), errhint("Add pg_curl to shared_preload_libraries.")));
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("return type must be a row type")));
+    for (int i = 0; i < 3; i++) if (!PG_ARGISNULL(i)) {
+        args[i] = PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(i));
+        offset += MAXALIGN(VARSIZE_ANY_EXHDR(args[i]));
+    }
+    if (!PG_ARGISNULL(3)) {
+#if PG_VERSION_NUM >= 110000
+        Jsonb *headers = PG_GETARG_JSONB_P(3);
+#else
+        Jsonb *headers = PG_GETARG_JSONB(3);
+#endif
+        pg_curl_header_append_jsonb(NULL, headers); // validate here, so that the worker never fails on them
+        args[3] = (struct varlena *)headers;
+        offset += MAXALIGN(VARSIZE(args[3]));
+    }
+    seg = dsm_create(offset + PG_CURL_WORKER_MQ_SIZE, 0);
+    message = dsm_segment_address(seg);
+    message->timeout_ms = PG_ARGISNULL(4) ? 0 : PG_GETARG_INT32(4);
+    message->mq = offset;
+    data = (char *)message + MAXALIGN(sizeof(*message));
+    for (int i = 0; i < 4; i++) {
+        if ((message->isnull[i] = !args[i])) message->len[i] = 0;
+        else if (i < 3) memcpy(data, VARDATA_ANY(args[i]), message->len[i] = VARSIZE_ANY_EXHDR(args[i]));
+        else memcpy(data, args[i], message->len[i] = VARSIZE(args[i]));
+        data += MAXALIGN(message->len[i]);
+    }
+    mq = shm_mq_create((char *)message + offset, PG_CURL_WORKER_MQ_SIZE);
+    shm_mq_set_receiver(mq, MyProc);
+    mqh = shm_mq_attach(mq, seg, NULL);
+    generation = pg_curl_worker_enqueue(dsm_segment_handle(seg));
+    for (;;) { // worker is not our child, so there is no handle to watch, poll its liveness instead of blocking on the queue
+        shm_mq_result res = shm_mq_receive(mqh, &len, (void **)&data, true);
+        if (res == SHM_MQ_SUCCESS) break;
+        if (res == SHM_MQ_DETACHED || !pg_curl_worker_alive(generation)) ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE), errmsg("pg_curl worker exited before replying")));
+        if (WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 1000, PG_WAIT_EXTENSION) & WL_POSTMASTER_DEATH) ereport(FATAL, (errcode(ERRCODE_ADMIN_SHUTDOWN), errmsg("terminating pg_curl due to unexpected postmaster exit")));
+        ResetLatch(MyLatch);
+        CHECK_FOR_INTERRUPTS();
+    }
+    if (len < sizeof(reply)) ereport(ERROR, (errcode(ERRCODE_PROTOCOL_VIOLATION), errmsg("invalid pg_curl worker reply size %zu", len)));
+    memcpy(&reply, data, sizeof(reply));
+    if (len != sizeof(reply) + reply.len[0] + reply.len[1] + reply.len[2]) ereport(ERROR, (errcode(ERRCODE_PROTOCOL_VIOLATION), errmsg("invalid pg_curl worker reply size %zu", len)));
+    data += sizeof(reply);
+    if (reply.sqlerrcode) {
+        char *error = pnstrdup(data, reply.len[0]);
+        dsm_detach(seg);
+        ereport(ERROR, (errcode(reply.sqlerrcode), errmsg("%s", error)));
+    }
+    values[0] = Int64GetDatum(reply.errcode);
+    if (reply.len[0]) values[1] = PointerGetDatum(cstring_to_text_with_len(data, reply.len[0])); else nulls[1] = true;
+    data += reply.len[0];
+    values[2] = Int64GetDatum(reply.response_code);
+    if (reply.len[1]) values[3] = PointerGetDatum(cstring_to_text_with_len(data, reply.len[1])); else nulls[3] = true;
+    data += reply.len[1];
+    if (reply.len[2]) values[4] = PointerGetDatum(cstring_to_text_with_len(data, reply.len[2])); else nulls[4] = true;
+    values[5] = Float8GetDatum(reply.total_time);
+    dsm_detach(seg);
+    PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls)));
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_worker_perform requires PostgreSQL 10 or later")));
+#endif
+}
+
+EXTENSION(pg_curl_async_trigger) {
+#if PG_VERSION_NUM >= 100000
+    static bool registered = false;
+    bool isnull;
+    Datum headers;
+    TriggerData *trigdata = (TriggerData *)fcinfo->context;
+    if (!CALLED_AS_TRIGGER(fcinfo)) ereport(ERROR, (errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED), errmsg("curl_async_trigger: not called by trigger manager")));
+    if (!TRIGGER_FIRED_FOR_ROW(trigdata->tg_event) || !TRIGGER_FIRED_BEFORE(trigdata->tg_event) || !TRIGGER_FIRED_BY_INSERT(trigdata->tg_event)) ereport(ERROR, (errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED), errmsg("curl_async_trigger: must be fired before insert for each row")));
+    headers = heap_getattr(trigdata->tg_trigtuple, SPI_fnumber(trigdata->tg_relation->rd_att, "headers"), trigdata->tg_relation->rd_att, &isnull);
+#if PG_VERSION_NUM >= 110000
+    if (!isnull) pg_curl_header_append_jsonb(NULL, DatumGetJsonbP(headers));
+#else
+    if (!isnull) pg_curl_header_append_jsonb(NULL, DatumGetJsonb(headers));
+#endif
+    if (!registered) {
+        RegisterXactCallback(pg_curl_worker_xact_callback, NULL);
+        registered = true;
+    }
+    pg_curl_worker.wakeup = true;
+    return PointerGetDatum(trigdata->tg_trigtuple);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_async_trigger requires PostgreSQL 10 or later")));
+#endif
 }
 
 static void pg_curl_check_error(pg_curl_t *curl) {
+    pg_curl_callback_rethrow(curl);
     if (curl->errcode != CURLE_OK) {
+        if (curl->rejected) ereport(ERROR, (errcode(PG_CURL_ERRCODE_BREAKER), errmsg("%s", curl->errbuf)));
+        if (curl->limit) ereport(ERROR, (errcode(PG_CURL_ERRCODE_LIMIT), errmsg("response exceeds %s", curl->limit), errdetail("%s", curl_easy_strerror(curl->errcode))));
         if (curl->errbuf[0]) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode)), errdetail("%s", curl->errbuf)));
         else ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
     }
 }
 
+#if PG_VERSION_NUM >= 120000
+typedef struct pg_curl_copy_t {
+    bool checked;
+    bool done;
+    pg_curl_multi_state_t state;
+    pg_curl_t *curl;
+    struct pg_curl_copy_t *outer;
+} pg_curl_copy_t;
+
+static pg_curl_copy_t *pg_curl_copy; // COPY source callback has no argument, outer is restored after nested curl_copy_from of a trigger
+
+static void pg_curl_copy_check(pg_curl_copy_t *copy) { // error body must not reach COPY, handle option CURLOPT_FAILONERROR is left as user set it
+    CURLcode ec;
+    long response_code;
+    if (copy->checked) return;
+    if ((ec = curl_easy_getinfo(copy->curl->easy, CURLINFO_RESPONSE_CODE, &response_code)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(ec), errmsg("%s", curl_easy_strerror(ec))));
+    if (response_code >= 400) ereport(ERROR, (pg_curl_ec(CURLE_HTTP_RETURNED_ERROR), errmsg("%s", curl_easy_strerror(CURLE_HTTP_RETURNED_ERROR)), errdetail("The requested URL returned error: %ld", response_code)));
+    copy->checked = true;
+}
+
+static int pg_curl_copy_source(void *outbuf, int minread, int maxread) {
+    int bytesread = 0;
+    pg_curl_copy_t *copy = pg_curl_copy;
+    StringInfo data_in = &copy->curl->data_in;
+    while (bytesread < minread) {
+        int size;
+        if (data_in->cursor >= data_in->len) {
+            pg_curl_t *curl;
+            pg_curl_varlena_reset(data_in);
+            if (copy->done) break;
+            if (pg_curl_multi_done_take(copy->curl)) copy->done = true;
+            else {
+                pg_curl_multi_wait_my(&copy->state);
+                while ((curl = pg_curl_multi_info_read_my(&copy->state))) {
+                    if (curl == copy->curl) copy->done = true;
+                    else pg_curl_multi_done_keep(curl);
+                }
+            }
+            if (copy->done) {
+                pg_curl_check_error(copy->curl);
+                pg_curl_copy_check(copy);
+            }
+            continue;
+        }
+        pg_curl_copy_check(copy);
+        size = Min(maxread - bytesread, data_in->len - data_in->cursor);
+        memcpy((char *)outbuf + bytesread, data_in->data + data_in->cursor, size);
+        data_in->cursor += size;
+        bytesread += size;
+    }
+    return bytesread;
+}
+
+static Node *pg_curl_copy_option(JsonbValue *v) {
+    switch (v->type) {
+        case jbvBool: return (Node *)makeString(pstrdup(v->val.boolean ? "true" : "false"));
+        case jbvNull: return NULL;
+        case jbvNumeric: return (Node *)makeString(DatumGetCString(DirectFunctionCall1(numeric_out, NumericGetDatum(v->val.numeric))));
+        case jbvString: return (Node *)makeString(pnstrdup(v->val.string.val, v->val.string.len));
+        case jbvBinary: {
+            int r;
+            JsonbIterator *it = JsonbIteratorInit(v->val.binary.data);
+            JsonbValue elem;
+            List *list = NIL;
+            while ((r = JsonbIteratorNext(&it, &elem, true)) != WJB_DONE) if (r == WJB_ELEM) list = lappend(list, pg_curl_copy_option(&elem));
+            return (Node *)list;
+        }
+        default: ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("unsupported copy option value")));
+    }
+    return NULL;
+}
+
+static List *pg_curl_copy_options(Jsonb *jsonb) {
+    char *name = NULL;
+    int r;
+    JsonbIterator *it;
+    JsonbValue v;
+    List *options = NIL;
+    if (!JB_ROOT_IS_OBJECT(jsonb)) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("options must be json object")));
+    it = JsonbIteratorInit(&jsonb->root);
+    while ((r = JsonbIteratorNext(&it, &v, true)) != WJB_DONE) switch (r) {
+        case WJB_KEY: name = pnstrdup(v.val.string.val, v.val.string.len); break;
+        case WJB_VALUE: options = lappend(options, makeDefElem(name, pg_curl_copy_option(&v), -1)); break;
+        default: break;
+    }
+    return options;
+}
+#endif
+
+EXTENSION(pg_curl_copy_from) {
+#if PG_VERSION_NUM >= 120000
+#if PG_VERSION_NUM >= 140000
+    CopyFromState cstate;
+#else
+    CopyState cstate;
+#endif
+    char *url = NULL;
+    List *options = NIL;
+    Oid relid;
+    ParseState *pstate;
+    pg_curl_copy_t copy = {.outer = pg_curl_copy, .state = {.ec = CURL_LAST, .timeout_ms = 1000, .try = 1}};
+    pg_curl_t *curl;
+    Relation rel;
+    uint64 processed;
+    if (PG_ARGISNULL(1)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_copy_from requires argument target")));
+    relid = PG_GETARG_OID(1);
+    curl = pg_curl_easy_init(PG_CONNAME(4));
+    if (curl->sink.kind) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_copy_from does not support sinks"), errhint("Call curl_easy_reset first.")));
+    for (pg_curl_copy_t *outer = pg_curl_copy; outer; outer = outer->outer) if (outer->curl == curl) ereport(ERROR, (errcode(ERRCODE_OBJECT_IN_USE), errmsg("handle is already used by curl_copy_from"), errhint("Use other conname.")));
+    if (!PG_ARGISNULL(2)) options = lappend(options, makeDefElem("format", (Node *)makeString(TextDatumGetCString(PG_GETARG_DATUM(2))), -1));
+    if (!PG_ARGISNULL(3)) options = list_concat(options, pg_curl_copy_options(PG_GETARG_JSONB_P(3)));
+    rel = table_open(relid, RowExclusiveLock);
+    if (pg_class_aclcheck(relid, GetUserId(), ACL_INSERT) != ACLCHECK_OK) ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE), errmsg("permission denied for table %s", RelationGetRelationName(rel))));
+    if (check_enable_rls(relid, InvalidOid, false) == RLS_ENABLED) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_copy_from is not supported for tables with row-level security")));
+    pstate = make_parsestate(NULL);
+    addRangeTableEntryForRelation(pstate, rel, RowExclusiveLock, NULL, false, false);
+    if (!PG_ARGISNULL(0)) { // url argument is for this call only
+        text *arg = PG_GETARG_TEXT_PP(0);
+        url = pstrdup(curl->url.data);
+        resetStringInfo(&curl->url);
+        appendBinaryStringInfo(&curl->url, VARDATA_ANY(arg), VARSIZE_ANY_EXHDR(arg));
+    }
+    copy.curl = curl;
+    pg_curl_copy = &copy;
+    PG_TRY(); {
+        pg_curl_multi_add_handle_my(curl);
+#if PG_VERSION_NUM >= 140000
+        cstate = BeginCopyFrom(pstate, rel, NULL, NULL, false, pg_curl_copy_source, NIL, options);
+#else
+        cstate = BeginCopyFrom(pstate, rel, NULL, false, pg_curl_copy_source, NIL, options);
+#endif
+        processed = CopyFrom(cstate);
+        EndCopyFrom(cstate);
+    } PG_CATCH(); {
+        pg_curl_copy = copy.outer;
+        if (url) {
+            resetStringInfo(&curl->url);
+            appendStringInfoString(&curl->url, url);
+        }
+        pg_curl_multi_remove_handle(curl, false);
+        PG_RE_THROW();
+    } PG_END_TRY();
+    pg_curl_copy = copy.outer;
+    if (url) {
+        resetStringInfo(&curl->url);
+        appendStringInfoString(&curl->url, url);
+    }
+    pg_curl_multi_remove_handle(curl, true);
+    free_parsestate(pstate);
+    table_close(rel, NoLock);
+    PG_RETURN_INT64(processed);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_copy_from requires PostgreSQL 12 or later")));
+#endif
+}
+
+typedef struct {
+    bool done;
+    bool reconnect;
+    bool timedout;
+    pg_curl_multi_state_t state;
+    pg_curl_t *curl;
+    StringInfoData line; // copy, so that response buffer of the handle is left intact
+    TimestampTz deadline;
+} pg_curl_stream_t;
+
+static void pg_curl_stream_shutdown(Datum arg) {
+    pg_curl_stream_t *stream = (pg_curl_stream_t *)DatumGetPointer(arg);
+    if (!stream->done) pg_curl_multi_remove_handle(stream->curl, false);
+    stream->done = true;
+}
+
+static pg_curl_stream_t *pg_curl_stream_init(PG_FUNCTION_ARGS, pg_curl_t *curl, Size size) { // size allows callers to extend the state
+    FuncCallContext *funcctx = SRF_FIRSTCALL_INIT();
+    MemoryContext oldMemoryContext;
+    pg_curl_stream_t *stream = MemoryContextAllocZero(funcctx->multi_call_memory_ctx, size);
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+    if (curl->sink.kind) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("streaming does not support sinks"), errhint("Call curl_easy_reset first.")));
+    stream->curl = curl;
+    stream->state = (pg_curl_multi_state_t){.ec = CURL_LAST, .timeout_ms = 1000, .try = 1};
+    oldMemoryContext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    initStringInfo(&stream->line);
+    MemoryContextSwitchTo(oldMemoryContext);
+    funcctx->user_fctx = stream;
+    if (rsinfo && IsA(rsinfo, ReturnSetInfo)) RegisterExprContextCallback(rsinfo->econtext, pg_curl_stream_shutdown, PointerGetDatum(stream));
+    return stream;
+}
+
+static void pg_curl_stream_perform(pg_curl_stream_t *stream) {
+    pg_curl_t *curl;
+    if (pg_curl_multi_done_take(stream->curl)) stream->done = true;
+    else {
+        pg_curl_multi_wait_my(&stream->state);
+        while ((curl = pg_curl_multi_info_read_my(&stream->state))) {
+            if (curl == stream->curl) stream->done = true;
+            else pg_curl_multi_done_keep(curl);
+        }
+    }
+    if (stream->done && !stream->reconnect) pg_curl_check_error(stream->curl);
+}
+
+static char *pg_curl_stream_line(pg_curl_stream_t *stream, int *len) { // returned line is valid until next call
+    StringInfo buf = &stream->curl->data_in;
+    for (;;) {
+        char *start = buf->data + buf->cursor;
+        char *eol = memchr(start, '\n', buf->len - buf->cursor);
+        if (eol || (stream->done && buf->cursor < buf->len)) {
+            if (!eol) eol = buf->data + buf->len;
+            *len = eol - start;
+            buf->cursor = Min(eol - buf->data + 1, buf->len);
+            if (*len && start[*len - 1] == '\r') (*len)--;
+            resetStringInfo(&stream->line);
+            appendBinaryStringInfo(&stream->line, start, *len);
+            return stream->line.data;
+        }
+        if (stream->done) {
+            pg_curl_varlena_reset(buf); // only a tail of the response is left after streaming
+            return NULL;
+        }
+        if (buf->cursor > VARHDRSZ) { // keep only partial line
+            memmove(buf->data + VARHDRSZ, start, buf->len - buf->cursor + 1);
+            buf->len -= buf->cursor - VARHDRSZ;
+            buf->cursor = VARHDRSZ;
+        }
+        if (stream->deadline) {
+            int usecs;
+            long secs;
+            TimestampTz now = GetCurrentTimestamp();
+            if (now >= stream->deadline) {
+                pg_curl_stream_shutdown(PointerGetDatum(stream));
+                stream->timedout = true;
+                return NULL;
+            }
+            TimestampDifference(now, stream->deadline, &secs, &usecs);
+            stream->state.timeout_ms = secs >= 1 ? 1000 : usecs / 1000 + 1;
+        }
+        pg_curl_stream_perform(stream);
+    }
+}
+
+EXTENSION(pg_curl_stream_lines) {
+    char *line;
+    FuncCallContext *funcctx;
+    int len;
+    if (SRF_IS_FIRSTCALL()) pg_curl_multi_add_handle_my(pg_curl_stream_init(fcinfo, pg_curl_easy_init(PG_CONNAME(0)), sizeof(pg_curl_stream_t))->curl);
+    funcctx = SRF_PERCALL_SETUP();
+    if (!(line = pg_curl_stream_line(funcctx->user_fctx, &len))) SRF_RETURN_DONE(funcctx);
+    SRF_RETURN_NEXT(funcctx, PointerGetDatum(cstring_to_text(pg_any_to_server(line, len, PG_UTF8))));
+}
+
+EXTENSION(pg_curl_stream_jsonb) {
+    char *line;
+    FuncCallContext *funcctx;
+    int len;
+    if (SRF_IS_FIRSTCALL()) pg_curl_multi_add_handle_my(pg_curl_stream_init(fcinfo, pg_curl_easy_init(PG_CONNAME(0)), sizeof(pg_curl_stream_t))->curl);
+    funcctx = SRF_PERCALL_SETUP();
+    while ((line = pg_curl_stream_line(funcctx->user_fctx, &len)) && !len);
+    if (!line) SRF_RETURN_DONE(funcctx);
+    SRF_RETURN_NEXT(funcctx, DirectFunctionCall1(jsonb_in, CStringGetDatum(pg_any_to_server(line, len, PG_UTF8))));
+}
+
+typedef struct {
+    pg_curl_stream_t stream; // first, so that the stream state can be shared with pg_curl_stream_line
+    int64 max_rows;
+    int64 rows;
+    int reconnects;
+    long retry;
+    StringInfoData data;
+    StringInfoData event;
+    StringInfoData id;
+    struct curl_slist *header;
+} pg_curl_sse_t;
+
+static void pg_curl_sse_shutdown(Datum arg) {
+    pg_curl_sse_t *sse = (pg_curl_sse_t *)DatumGetPointer(arg);
+    pg_curl_stream_shutdown(PointerGetDatum(&sse->stream));
+    if (!sse->header) return;
+    curl_easy_setopt(sse->stream.curl->easy, CURLOPT_HTTPHEADER, sse->stream.curl->header);
+    curl_slist_free_all(sse->header);
+    sse->header = NULL;
+}
+
+static void pg_curl_sse_header(pg_curl_sse_t *sse, const char *header) {
+    struct curl_slist *temp = sse->header;
+    if ((temp = curl_slist_append(temp, header))) sse->header = temp; else ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("!curl_slist_append")));
+}
+
+static void pg_curl_sse_connect(pg_curl_sse_t *sse) { // Last-Event-ID goes into a private copy of the header list, so the handle keeps its own headers
+    pg_curl_t *curl = sse->stream.curl;
+    struct curl_slist *header = curl->header;
+    curl_slist_free_all(sse->header);
+    sse->header = NULL;
+    for (struct curl_slist *temp = header; temp; temp = temp->next) pg_curl_sse_header(sse, temp->data);
+    pg_curl_sse_header(sse, "Accept: text/event-stream");
+    pg_curl_sse_header(sse, "Cache-Control: no-cache");
+    if (sse->id.len) {
+        char *last = psprintf("Last-Event-ID: %s", sse->id.data);
+        pg_curl_sse_header(sse, last);
+        pfree(last);
+    }
+    curl->header = sse->header;
+    PG_TRY();
+        pg_curl_multi_add_handle_my(curl);
+    PG_CATCH();
+        curl->header = header;
+        PG_RE_THROW();
+    PG_END_TRY();
+    curl->header = header;
+    sse->stream.done = false;
+}
+
+static bool pg_curl_sse_reconnect(pg_curl_sse_t *sse) {
+    char *content_type = NULL;
+    char *scheme = NULL;
+    long response_code = 0;
+    pg_curl_t *curl = sse->stream.curl;
+    TimestampTz until;
+    if (sse->stream.timedout) return false;
+#if CURL_AT_LEAST_VERSION(7, 52, 0)
+    if (curl->errcode == CURLE_OK && (curl->errcode = curl_easy_getinfo(curl->easy, CURLINFO_SCHEME, &scheme)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+#endif
+    if (curl->errcode == CURLE_OK && (!scheme || !pg_strncasecmp(scheme, "http", sizeof("http") - 1))) { // other protocols, like file, have neither response code nor content type
+        if ((curl->errcode = curl_easy_getinfo(curl->easy, CURLINFO_RESPONSE_CODE, &response_code)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+        if (response_code == 204) return false; // server asks not to reconnect
+        if (response_code != 200) ereport(ERROR, (errcode(ERRCODE_PROTOCOL_VIOLATION), errmsg("server sent events require response code 200"), errdetail("response code is %li", response_code)));
+        if ((curl->errcode = curl_easy_getinfo(curl->easy, CURLINFO_CONTENT_TYPE, &content_type)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+        if (!content_type || pg_strncasecmp(content_type, "text/event-stream", sizeof("text/event-stream") - 1)) ereport(ERROR, (errcode(ERRCODE_PROTOCOL_VIOLATION), errmsg("server sent events require content type text/event-stream"), errdetail("content type is %s", content_type ? content_type : "missing")));
+    } else if (curl->errcode != CURLE_OK) {
+        if (pg_curl_easy_permanent(curl->errcode) || curl->limit || curl->errcode == CURLE_HTTP_RETURNED_ERROR) pg_curl_check_error(curl);
+        pg_curl_easy_warning(curl, ++sse->reconnects);
+    }
+    until = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), sse->retry);
+    if (sse->stream.deadline && sse->stream.deadline <= until) return false; // no event could arrive before max_time_ms
+    pg_curl_sleep_my(until);
+    resetStringInfo(&sse->data);
+    resetStringInfo(&sse->event);
+    pg_curl_sse_connect(sse);
+    return true;
+}
+
+static void pg_curl_sse_init(PG_FUNCTION_ARGS) {
+    MemoryContext oldMemoryContext;
+    pg_curl_sse_t *sse = (pg_curl_sse_t *)pg_curl_stream_init(fcinfo, pg_curl_easy_init(PG_CONNAME(3)), sizeof(pg_curl_sse_t));
+    FuncCallContext *funcctx = fcinfo->flinfo->fn_extra;
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+    TupleDesc tupdesc;
+    oldMemoryContext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("function returning record called in context that cannot accept type record")));
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+    initStringInfo(&sse->data);
+    initStringInfo(&sse->event);
+    initStringInfo(&sse->id);
+    sse->retry = 3000;
+    if (!PG_ARGISNULL(0) && (sse->max_rows = PG_GETARG_INT64(0)) <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("max_rows must be positive")));
+    if (!PG_ARGISNULL(1)) {
+        int max_time_ms = PG_GETARG_INT32(1);
+        if (max_time_ms <= 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("max_time_ms must be positive")));
+        sse->stream.deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), max_time_ms);
+    }
+    if (!PG_ARGISNULL(2)) appendStringInfoString(&sse->id, TextDatumGetCString(PG_GETARG_DATUM(2)));
+    sse->stream.reconnect = true;
+    if (rsinfo && IsA(rsinfo, ReturnSetInfo)) RegisterExprContextCallback(rsinfo->econtext, pg_curl_sse_shutdown, PointerGetDatum(sse));
+    MemoryContextSwitchTo(oldMemoryContext);
+    pg_curl_sse_connect(sse);
+}
+
+EXTENSION(pg_curl_stream_sse) {
+    FuncCallContext *funcctx;
+    pg_curl_sse_t *sse;
+    if (SRF_IS_FIRSTCALL()) pg_curl_sse_init(fcinfo);
+    funcctx = SRF_PERCALL_SETUP();
+    sse = funcctx->user_fctx;
+    while (!sse->max_rows || sse->rows < sse->max_rows) {
+        char *colon, *value;
+        int len;
+        char *line = pg_curl_stream_line(&sse->stream, &len);
+        if (!line) { // incomplete event is discarded like browsers do
+            if (pg_curl_sse_reconnect(sse)) continue;
+            break;
+        }
+        if (!len) { // blank line dispatches the event
+            bool nulls[3] = {false};
+            Datum values[3];
+            if (!sse->data.len) {
+                resetStringInfo(&sse->event);
+                continue;
+            }
+            if (!(nulls[0] = !sse->id.len)) values[0] = CStringGetTextDatum(pg_any_to_server(sse->id.data, sse->id.len, PG_UTF8));
+            values[1] = CStringGetTextDatum(sse->event.len ? pg_any_to_server(sse->event.data, sse->event.len, PG_UTF8) : "message");
+            values[2] = CStringGetTextDatum(pg_any_to_server(sse->data.data, sse->data.len, PG_UTF8));
+            resetStringInfo(&sse->data);
+            resetStringInfo(&sse->event);
+            sse->rows++;
+            SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
+        }
+        if (*line == ':') continue; // comment, used by servers as keep alive
+        if ((colon = memchr(line, ':', len))) {
+            *colon = '\0';
+            value = colon + 1;
+            if (*value == ' ') value++;
+        } else value = line + len;
+        if (!strcmp(line, "data")) {
+            if (sse->data.len) appendStringInfoChar(&sse->data, '\n');
+            appendStringInfoString(&sse->data, value);
+        } else if (!strcmp(line, "event")) {
+            resetStringInfo(&sse->event);
+            appendStringInfoString(&sse->event, value);
+        } else if (!strcmp(line, "id")) {
+            resetStringInfo(&sse->id);
+            appendStringInfoString(&sse->id, value);
+        } else if (!strcmp(line, "retry") && *value && strspn(value, "0123456789") == strlen(value)) sse->retry = Min(strtol(value, NULL, 10), INT_MAX);
+    }
+    pg_curl_sse_shutdown(PointerGetDatum(sse));
+    SRF_RETURN_DONE(funcctx);
+}
+
+#if CURL_AT_LEAST_VERSION(7, 86, 0) && PG_VERSION_NUM >= 100000
+static void pg_curl_ws_reset(pg_curl_t *curl) { // without connect only, next transfer of the handle is a plain request again
+    curl->ws = false;
+    curl_easy_setopt(curl->easy, CURLOPT_CONNECT_ONLY, 0L);
+}
+
+static void pg_curl_ws_error(pg_curl_t *curl) {
+    if (curl->errcode == CURLE_OK) return;
+    pg_curl_ws_reset(curl);
+    pg_curl_check_error(curl);
+}
+
+static void pg_curl_ws_connect(pg_curl_t *curl) { // handshake runs on the easy interface, because removing a connect only handle from multi closes its connection
+    char host[PG_CURL_LIMIT_HOST];
+    long delay;
+    if (curl->ws) return;
+    if (curl->sink.kind) ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("websocket does not support sinks"), errhint("Call curl_easy_reset first.")));
+    pg_curl_multi_remove_handle(curl, true);
+    if ((delay = pg_curl_breaker_admit(curl, host))) ereport(ERROR, (errcode(PG_CURL_ERRCODE_BREAKER), errmsg("circuit breaker of host \"%s\" is open", host), errdetail("Next probe in %li ms.", delay)));
+    if ((curl->errcode = pg_curl_easy_prepare(curl)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if ((curl->errcode = curl_easy_setopt(curl->easy, CURLOPT_CONNECT_ONLY, 2L)) != CURLE_OK) ereport(ERROR, (pg_curl_ec(curl->errcode), errmsg("%s", curl_easy_strerror(curl->errcode))));
+    if ((delay = pg_curl_limit_acquire(curl)) > 0) pg_curl_sleep_my(TimestampTzPlusMilliseconds(GetCurrentTimestamp(), delay / 1000)); // blocking handshake waits for its token here instead of in retry heap
+    pg_curl.transfers++;
+    curl->errcode = curl_easy_perform(curl->easy);
+    pg_curl_transfer_done(curl);
+    pg_curl_breaker_report(curl);
+    pg_curl_ws_error(curl);
+    curl->ws = true;
+}
+
+static bool pg_curl_ws_wait(pg_curl_t *curl, int events, TimestampTz deadline) {
+    curl_socket_t sock;
+    int rc;
+    long timeout = -1;
+    if ((curl->errcode = curl_easy_getinfo(curl->easy, CURLINFO_ACTIVESOCKET, &sock)) != CURLE_OK) pg_curl_ws_error(curl);
+    if (sock == CURL_SOCKET_BAD) {
+        pg_curl_ws_reset(curl);
+        ereport(ERROR, (errcode(ERRCODE_CONNECTION_DOES_NOT_EXIST), errmsg("websocket is closed")));
+    }
+    if (deadline) {
+        int usecs;
+        long secs;
+        TimestampDifference(GetCurrentTimestamp(), deadline, &secs, &usecs);
+        if (!(timeout = secs * 1000 + usecs / 1000) && !usecs) return false;
+        events |= WL_TIMEOUT;
+    }
+    rc = WaitLatchOrSocket(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH | events, sock, timeout, PG_WAIT_EXTENSION);
+    if (rc & WL_POSTMASTER_DEATH) ereport(FATAL, (errcode(ERRCODE_ADMIN_SHUTDOWN), errmsg("terminating pg_curl due to unexpected postmaster exit")));
+    if (rc & WL_LATCH_SET) ResetLatch(MyLatch);
+    CHECK_FOR_INTERRUPTS();
+    return !(rc & WL_TIMEOUT);
+}
+
+static unsigned int pg_curl_ws_flags(const char *opcode) {
+    if (!pg_strcasecmp(opcode, "text")) return CURLWS_TEXT;
+    if (!pg_strcasecmp(opcode, "binary")) return CURLWS_BINARY;
+    if (!pg_strcasecmp(opcode, "close")) return CURLWS_CLOSE;
+    if (!pg_strcasecmp(opcode, "ping")) return CURLWS_PING;
+    if (!pg_strcasecmp(opcode, "pong")) return CURLWS_PONG;
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("unsupported opcode \"%s\"", opcode), errhint("Use text, binary, close, ping or pong.")));
+}
+
+static const char *pg_curl_ws_opcode(int flags) {
+    if (flags & CURLWS_TEXT) return "text";
+    if (flags & CURLWS_CLOSE) return "close";
+    if (flags & CURLWS_PING) return "ping";
+    if (flags & CURLWS_PONG) return "pong";
+    return "binary";
+}
+
+static void pg_curl_ws_send_my(pg_curl_t *curl, const char *data, size_t len, unsigned int flags) {
+    size_t offset = 0;
+    pg_curl_ws_connect(curl);
+    do {
+        size_t sent = 0;
+        curl->errcode = curl_ws_send(curl->easy, data + offset, len - offset, &sent, 0, flags);
+        offset += sent;
+        if (curl->errcode == CURLE_AGAIN) pg_curl_ws_wait(curl, WL_SOCKET_WRITEABLE, 0);
+        else pg_curl_ws_error(curl);
+    } while (curl->errcode == CURLE_AGAIN || offset < len);
+    if (flags & CURLWS_CLOSE) pg_curl_ws_reset(curl);
+}
+#endif
+
+EXTENSION(pg_curl_ws_send) {
+#if CURL_AT_LEAST_VERSION(7, 86, 0) && PG_VERSION_NUM >= 100000
+    bytea *payload;
+    char *opcode;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(2));
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_ws_send requires argument payload")));
+    if (PG_ARGISNULL(1)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_ws_send requires argument opcode")));
+    payload = PG_GETARG_BYTEA_PP(0);
+    opcode = TextDatumGetCString(PG_GETARG_DATUM(1));
+    pg_curl_ws_send_my(curl, VARDATA_ANY(payload), VARSIZE_ANY_EXHDR(payload), pg_curl_ws_flags(opcode));
+    pfree(opcode);
+    PG_RETURN_BOOL(true);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_ws_send requires curl 7.86.0 and PostgreSQL 10 or later")));
+#endif
+}
+
+EXTENSION(pg_curl_ws_send_text) {
+#if CURL_AT_LEAST_VERSION(7, 86, 0) && PG_VERSION_NUM >= 100000
+    char *opcode;
+    char *payload;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(2));
+    text *data;
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_ws_send requires argument payload")));
+    if (PG_ARGISNULL(1)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_ws_send requires argument opcode")));
+    data = PG_GETARG_TEXT_PP(0);
+    opcode = TextDatumGetCString(PG_GETARG_DATUM(1));
+    payload = pg_server_to_any(VARDATA_ANY(data), VARSIZE_ANY_EXHDR(data), PG_UTF8);
+    pg_curl_ws_send_my(curl, payload, payload == VARDATA_ANY(data) ? VARSIZE_ANY_EXHDR(data) : strlen(payload), pg_curl_ws_flags(opcode));
+    pfree(opcode);
+    PG_RETURN_BOOL(true);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_ws_send requires curl 7.86.0 and PostgreSQL 10 or later")));
+#endif
+}
+
+EXTENSION(pg_curl_ws_recv) {
+#if CURL_AT_LEAST_VERSION(7, 86, 0) && PG_VERSION_NUM >= 100000
+    int flags = 0;
+    int64 count = 0;
+    int64 max_messages = PG_ARGISNULL(1) ? 0 : PG_GETARG_INT64(1);
+    int timeout_ms = PG_ARGISNULL(0) ? 0 : PG_GETARG_INT32(0);
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(2));
+    StringInfoData buf;
+    StringInfoData control;
+    TimestampTz deadline = 0;
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore = pg_curl_tuplestore(fcinfo, &tupdesc);
+    if (timeout_ms < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("timeout_ms must not be negative")));
+    if (max_messages < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("max_messages must not be negative")));
+    pg_curl_ws_connect(curl);
+    initStringInfo(&buf);
+    initStringInfo(&control);
+    if (timeout_ms) deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout_ms);
+    while (!max_messages || count < max_messages) {
+        bool nulls[2] = {false};
+        const struct curl_ws_frame *meta;
+        Datum values[2];
+        size_t len = 0;
+        StringInfo message = &buf;
+        enlargeStringInfo(&buf, 65536);
+        curl->errcode = curl_ws_recv(curl->easy, buf.data + buf.len, buf.maxlen - buf.len - 1, &len, &meta);
+        if (curl->errcode == CURLE_AGAIN) { // timeout applies only between messages, a started message is always completed
+            if (!pg_curl_ws_wait(curl, WL_SOCKET_READABLE, buf.len || flags || control.len ? 0 : deadline) && !buf.len && !flags && !control.len) break;
+            continue;
+        }
+        pg_curl_ws_error(curl);
+        if (meta->flags & (CURLWS_CLOSE | CURLWS_PING | CURLWS_PONG)) { // control frame may arrive between fragments of a message, so it is kept apart
+            appendBinaryStringInfo(&control, buf.data + buf.len, len);
+            if (meta->bytesleft) continue;
+            message = &control;
+            values[0] = CStringGetTextDatum(pg_curl_ws_opcode(meta->flags));
+        } else {
+            if (!flags) flags = meta->flags;
+            buf.len += len;
+            buf.data[buf.len] = '\0';
+            if (meta->bytesleft || meta->flags & CURLWS_CONT) continue;
+            values[0] = CStringGetTextDatum(pg_curl_ws_opcode(flags));
+            flags = 0;
+        }
+        values[1] = PointerGetDatum(cstring_to_text_with_len(message->data, message->len));
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+        resetStringInfo(message);
+        count++;
+        if (message == &control && meta->flags & CURLWS_CLOSE) {
+            pg_curl_ws_reset(curl);
+            break;
+        }
+        if (timeout_ms && !buf.len && !flags) deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout_ms);
+    }
+    pfree(control.data);
+    pfree(buf.data);
+    return (Datum)0;
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_ws_recv requires curl 7.86.0 and PostgreSQL 10 or later")));
+#endif
+}
+
+EXTENSION(pg_curl_ws_close) {
+#if CURL_AT_LEAST_VERSION(7, 86, 0) && PG_VERSION_NUM >= 100000
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    uint16 status = htons(1000);
+    if (!curl->ws) PG_RETURN_BOOL(false);
+    pg_curl_ws_send_my(curl, (const char *)&status, sizeof(status), CURLWS_CLOSE);
+    PG_RETURN_BOOL(true);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_ws_close requires curl 7.86.0 and PostgreSQL 10 or later")));
+#endif
+}
+
 EXTENSION(pg_curl_easy_getinfo_debug) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
     pg_curl_check_error(curl);
@@ -1882,8 +5062,139 @@ EXTENSION(pg_curl_easy_getinfo_debug) {
 EXTENSION(pg_curl_easy_getinfo_header_in) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
     pg_curl_check_error(curl);
-    if (!curl->header_in.len) PG_RETURN_NULL();
-    PG_RETURN_TEXT_P(cstring_to_text_with_len(curl->header_in.data, curl->header_in.len));
+    if (!PG_CURL_VARLENA_LEN(&curl->header_in)) PG_RETURN_NULL();
+    PG_RETURN_DATUM(pg_curl_varlena_copy(&curl->header_in));
+}
+
+typedef struct {
+    char *name;
+    char *value;
+    int response;
+} pg_curl_header_t;
+
+static List *pg_curl_easy_header_list(pg_curl_t *curl, int *responses) {
+    char *data = PG_CURL_VARLENA_DATA(&curl->header_in);
+    char *end = data + PG_CURL_VARLENA_LEN(&curl->header_in);
+    List *list = NIL;
+    *responses = 0;
+    while (data < end) {
+        char *colon;
+        char *eol = memchr(data, '\n', end - data);
+        char *next = eol ? eol + 1 : end;
+        if (!eol) eol = end;
+        if (eol > data && eol[-1] == '\r') eol--;
+        if (eol - data >= 5 && !strncmp(data, "HTTP/", 5)) (*responses)++;
+        else if (*data != ' ' && *data != '\t' && (colon = memchr(data, ':', eol - data)) && colon > data) {
+            char *value = colon + 1;
+            pg_curl_header_t *header = palloc(sizeof(*header));
+            while (value < eol && (*value == ' ' || *value == '\t')) value++;
+            while (eol > value && (eol[-1] == ' ' || eol[-1] == '\t')) eol--;
+            header->name = pnstrdup(data, colon - data);
+            header->value = pnstrdup(value, eol - value);
+            header->response = Max(*responses, 1);
+            list = lappend(list, header);
+        }
+        data = next;
+    }
+    if (list && !*responses) *responses = 1;
+    return list;
+}
+
+EXTENSION(pg_curl_easy_getinfo_headers_table) {
+    int responses;
+    ListCell *lc;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore = pg_curl_tuplestore(fcinfo, &tupdesc);
+    pg_curl_check_error(curl);
+    foreach (lc, pg_curl_easy_header_list(curl, &responses)) {
+        bool nulls[3] = {false};
+        Datum values[3];
+        pg_curl_header_t *header = lfirst(lc);
+        values[0] = CStringGetTextDatum(header->name);
+        values[1] = CStringGetTextDatum(header->value);
+        values[2] = Int32GetDatum(header->response);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    return (Datum)0;
+}
+
+EXTENSION(pg_curl_easy_getinfo_headers_jsonb) {
+    bool first = true;
+    int responses;
+    List *list;
+    ListCell *lc;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    StringInfoData buf;
+    pg_curl_check_error(curl);
+    if (!(list = pg_curl_easy_header_list(curl, &responses))) PG_RETURN_NULL();
+    foreach (lc, list) { // keys are lower case, values of repeated headers are collected into array
+        pg_curl_header_t *header = lfirst(lc);
+        char *name = header->name;
+        for (; *name; name++) *name = pg_tolower((unsigned char)*name);
+    }
+    initStringInfo(&buf);
+    appendStringInfoChar(&buf, '{');
+    foreach (lc, list) {
+        int count = 0;
+        ListCell *lc2;
+        pg_curl_header_t *header = lfirst(lc);
+        if (header->response != responses || !header->value) continue;
+        foreach (lc2, list) {
+            pg_curl_header_t *other = lfirst(lc2);
+            if (other->response == responses && other->value && !strcmp(other->name, header->name)) count++;
+        }
+        if (!first) appendStringInfoChar(&buf, ',');
+        first = false;
+        escape_json(&buf, header->name);
+        appendStringInfoChar(&buf, ':');
+        if (count > 1) appendStringInfoChar(&buf, '[');
+        count = 0;
+        foreach (lc2, list) {
+            pg_curl_header_t *other = lfirst(lc2);
+            if (other->response != responses || !other->value || strcmp(other->name, header->name)) continue;
+            if (count++) appendStringInfoChar(&buf, ',');
+            escape_json(&buf, other->value);
+            other->value = NULL;
+        }
+        if (count > 1) appendStringInfoChar(&buf, ']');
+    }
+    appendStringInfoChar(&buf, '}');
+    PG_RETURN_DATUM(DirectFunctionCall1(jsonb_in, CStringGetDatum(buf.data)));
+}
+
+static char *pg_curl_easy_header_my(pg_curl_t *curl, const char *name) {
+    int responses;
+    ListCell *lc;
+    List *list = pg_curl_easy_header_list(curl, &responses);
+    foreach (lc, list) {
+        pg_curl_header_t *header = lfirst(lc);
+        if (header->response == responses && !pg_strcasecmp(header->name, name)) return header->value;
+    }
+    return NULL;
+}
+
+EXTENSION(pg_curl_easy_header) {
+    char *name;
+    char *value;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
+#if CURL_AT_LEAST_VERSION(7, 84, 0)
+    CURLHcode hc;
+    struct curl_header *header;
+#endif
+    if (PG_ARGISNULL(0)) ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("curl_easy_header requires argument name")));
+    name = TextDatumGetCString(PG_GETARG_DATUM(0));
+    pg_curl_check_error(curl);
+#if CURL_AT_LEAST_VERSION(7, 84, 0)
+    switch ((hc = curl_easy_header(curl->easy, name, 0, CURLH_HEADER, -1, &header))) {
+        case CURLHE_OK: PG_RETURN_TEXT_P(cstring_to_text(header->value));
+        case CURLHE_BADINDEX: case CURLHE_MISSING: case CURLHE_NOHEADERS: case CURLHE_NOREQUEST: PG_RETURN_NULL();
+        case CURLHE_NOT_BUILT_IN: break;
+        default: ereport(ERROR, (errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION), errmsg("curl_easy_header failed with code %i", hc)));
+    }
+#endif
+    if (!(value = pg_curl_easy_header_my(curl, name))) PG_RETURN_NULL();
+    PG_RETURN_TEXT_P(cstring_to_text(value));
 }
 
 EXTENSION(pg_curl_easy_getinfo_header_out) {
@@ -1896,8 +5207,78 @@ EXTENSION(pg_curl_easy_getinfo_header_out) {
 EXTENSION(pg_curl_easy_getinfo_data_in) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
     pg_curl_check_error(curl);
-    if (!curl->data_in.len) PG_RETURN_NULL();
-    PG_RETURN_BYTEA_P(cstring_to_text_with_len(curl->data_in.data, curl->data_in.len));
+    if (!PG_CURL_VARLENA_LEN(&curl->data_in)) PG_RETURN_NULL();
+    PG_RETURN_DATUM(pg_curl_varlena_copy(&curl->data_in));
+}
+
+static char *pg_curl_easy_data_in_server(pg_curl_t *curl, int encoding) { // verifies, and converts only if encoding differs
+    return pg_any_to_server(PG_CURL_VARLENA_DATA(&curl->data_in), PG_CURL_VARLENA_LEN(&curl->data_in), encoding);
+}
+
+EXTENSION(pg_curl_easy_getinfo_data_in_json) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    pg_curl_check_error(curl);
+    if (!PG_CURL_VARLENA_LEN(&curl->data_in)) PG_RETURN_NULL();
+    PG_RETURN_DATUM(DirectFunctionCall1(json_in, CStringGetDatum(pg_curl_easy_data_in_server(curl, PG_UTF8))));
+}
+
+EXTENSION(pg_curl_easy_getinfo_data_in_jsonb) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    pg_curl_check_error(curl);
+    if (!PG_CURL_VARLENA_LEN(&curl->data_in)) PG_RETURN_NULL();
+    PG_RETURN_DATUM(DirectFunctionCall1(jsonb_in, CStringGetDatum(pg_curl_easy_data_in_server(curl, PG_UTF8))));
+}
+
+EXTENSION(pg_curl_easy_getinfo_data_in_text) {
+    char *data;
+    int encoding = PG_UTF8;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(1));
+    if (!PG_ARGISNULL(0)) {
+        char *name = TextDatumGetCString(PG_GETARG_DATUM(0));
+        if ((encoding = pg_char_to_encoding(name)) < 0) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("invalid encoding name \"%s\"", name)));
+    }
+    pg_curl_check_error(curl);
+    if (!PG_CURL_VARLENA_LEN(&curl->data_in)) PG_RETURN_NULL();
+    if ((data = pg_curl_easy_data_in_server(curl, encoding)) == PG_CURL_VARLENA_DATA(&curl->data_in)) PG_RETURN_DATUM(pg_curl_varlena_copy(&curl->data_in));
+    PG_RETURN_TEXT_P(cstring_to_text(data));
+}
+
+EXTENSION(pg_curl_easy_getinfo_data_in_take) {
+    Datum data_in;
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    pg_curl_check_error(curl);
+    if (!PG_CURL_VARLENA_LEN(&curl->data_in)) PG_RETURN_NULL();
+    data_in = pg_curl_varlena(&curl->data_in);
+    MemoryContextSetParent(curl->data_in_context, CurrentMemoryContext);
+    pg_curl_easy_data_in_init(curl, pg_curl.context);
+    PG_RETURN_DATUM(data_in);
+}
+
+EXTENSION(pg_curl_easy_getinfo_data_in_chunks) {
+    bytea *chunk;
+    FuncCallContext *funcctx;
+    int size;
+    pg_curl_t *curl;
+    size_t len;
+    if (SRF_IS_FIRSTCALL()) {
+        funcctx = SRF_FIRSTCALL_INIT();
+        curl = pg_curl_easy_init(PG_CONNAME(1));
+        pg_curl_check_error(curl);
+        if ((size = PG_ARGISNULL(0) ? 1048576 : PG_GETARG_INT32(0)) <= 0 || (Size)size > MaxAllocSize - VARHDRSZ) ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("curl_easy_getinfo_data_in_chunks invalid argument size %i", size), errhint("Argument size must be positive and less than 1GB!")));
+        if (curl->sink.kind != 't' || curl->sink.lxid != pg_curl_lxid() || !curl->sink.buffile) ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE), errmsg("curl_easy_getinfo_data_in_chunks requires a tempfile sink performed in this transaction")));
+        if (BufFileSeek(curl->sink.buffile, 0, 0, SEEK_SET)) ereport(ERROR, (errcode_for_file_access(), errmsg("could not seek in temporary file")));
+        funcctx->user_fctx = curl;
+    }
+    funcctx = SRF_PERCALL_SETUP();
+    curl = funcctx->user_fctx;
+    size = PG_ARGISNULL(0) ? 1048576 : PG_GETARG_INT32(0);
+    chunk = palloc(size + VARHDRSZ);
+    if (!(len = BufFileRead(curl->sink.buffile, VARDATA(chunk), size))) {
+        pfree(chunk);
+        SRF_RETURN_DONE(funcctx);
+    }
+    SET_VARSIZE(chunk, len + VARHDRSZ);
+    SRF_RETURN_NEXT(funcctx, PointerGetDatum(chunk));
 }
 
 EXTENSION(pg_curl_easy_getinfo_data_out) {
@@ -1928,6 +5309,11 @@ EXTENSION(pg_curl_easy_getinfo_errdesc) {
     PG_RETURN_TEXT_P(cstring_to_text(curl_easy_strerror(curl->errcode)));
 }
 
+EXTENSION(pg_curl_easy_getinfo_attempts) {
+    pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
+    PG_RETURN_INT32(curl->try);
+}
+
 EXTENSION(pg_curl_easy_getinfo_errcode) {
     pg_curl_t *curl = pg_curl_easy_init(PG_CONNAME(0));
     PG_RETURN_INT64(curl->errcode);
@@ -2208,6 +5594,21 @@ EXTENSION(pg_curl_http_version_3) {
 }
 EXTENSION(pg_curl_http_version_none) { PG_RETURN_INT64(CURL_HTTP_VERSION_NONE); }
 
+EXTENSION(pg_curlpipe_nothing) {
+#if CURL_AT_LEAST_VERSION(7, 43, 0)
+    PG_RETURN_INT64(CURLPIPE_NOTHING);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curlpipe_nothing requires curl 7.43.0 or later")));
+#endif
+}
+EXTENSION(pg_curlpipe_multiplex) {
+#if CURL_AT_LEAST_VERSION(7, 43, 0)
+    PG_RETURN_INT64(CURLPIPE_MULTIPLEX);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curlpipe_multiplex requires curl 7.43.0 or later")));
+#endif
+}
+
 EXTENSION(pg_curlusessl_none) {
 #if CURL_AT_LEAST_VERSION(7, 11, 0)
     PG_RETURN_INT64(CURLUSESSL_NONE);
@@ -2946,6 +6347,30 @@ EXTENSION(pg_curlftp_create_dir_none) {
 #endif
 }
 
+EXTENSION(pg_curl_lock_data_cookie) { PG_RETURN_INT64(CURL_LOCK_DATA_COOKIE); }
+EXTENSION(pg_curl_lock_data_dns) { PG_RETURN_INT64(CURL_LOCK_DATA_DNS); }
+EXTENSION(pg_curl_lock_data_ssl_session) {
+#if CURL_AT_LEAST_VERSION(7, 10, 3)
+    PG_RETURN_INT64(CURL_LOCK_DATA_SSL_SESSION);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_lock_data_ssl_session requires curl 7.10.3 or later")));
+#endif
+}
+EXTENSION(pg_curl_lock_data_connect) {
+#if CURL_AT_LEAST_VERSION(7, 57, 0)
+    PG_RETURN_INT64(CURL_LOCK_DATA_CONNECT);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_lock_data_connect requires curl 7.57.0 or later")));
+#endif
+}
+EXTENSION(pg_curl_lock_data_psl) {
+#if CURL_AT_LEAST_VERSION(7, 61, 0)
+    PG_RETURN_INT64(CURL_LOCK_DATA_PSL);
+#else
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("curl_lock_data_psl requires curl 7.61.0 or later")));
+#endif
+}
+
 EXTENSION(pg_curl_max_write_size) {
 #ifdef CURL_MAX_WRITE_SIZE
     PG_RETURN_INT64(CURL_MAX_WRITE_SIZE);
@@ -2956,6 +6381,62 @@ EXTENSION(pg_curl_max_write_size) {
 
 #if PG_VERSION_NUM >= 90500
 void _PG_init(void); void _PG_init(void) {
+    DefineCustomBoolVariable("pg_curl.deferred", "pg_curl deferred", "Perform curl_multi_add_handle requests only after commit?", &pg_curl.deferred, false, PGC_USERSET, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.deferred_timeout", "pg_curl deferred timeout", "Maximum time commit waits for deferred requests.", &pg_curl.deferred_timeout, 10000, 1, INT_MAX, PGC_USERSET, GUC_UNIT_MS, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.max_concurrent_streams", "pg_curl max concurrent streams", "Maximum number of concurrent streams of a multiplexed connection.", &pg_curl.max_concurrent_streams, 100, 1, INT_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+#if PG_VERSION_NUM >= 110000
+    DefineCustomIntVariable("pg_curl.max_header_bytes", "pg_curl max header bytes", "Abort transfers with larger response headers (0 is unlimited).", &pg_curl.max_header_bytes, 0, 0, INT_MAX, PGC_USERSET, GUC_UNIT_BYTE, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.max_response_bytes", "pg_curl max response bytes", "Abort transfers with a larger response body (0 is unlimited).", &pg_curl.max_response_bytes, 0, 0, INT_MAX, PGC_USERSET, GUC_UNIT_BYTE, NULL, NULL, NULL);
+#else
+    DefineCustomIntVariable("pg_curl.max_header_bytes", "pg_curl max header bytes", "Abort transfers with larger response headers (0 is unlimited).", &pg_curl.max_header_bytes, 0, 0, INT_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.max_response_bytes", "pg_curl max response bytes", "Abort transfers with a larger response body (0 is unlimited).", &pg_curl.max_response_bytes, 0, 0, INT_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+#endif
+    DefineCustomIntVariable("pg_curl.max_host_connections", "pg_curl max host connections", "Maximum number of connections of the multi handle to a single host (0 is unlimited).", &pg_curl.max_host_connections, 0, 0, INT_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.max_total_connections", "pg_curl max total connections", "Maximum number of connections of the multi handle in total (0 is unlimited).", &pg_curl.max_total_connections, 0, 0, INT_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.maxconnects", "pg_curl maxconnects", "Size of the connection cache of the multi handle (0 is libcurl default).", &pg_curl.maxconnects, 0, 0, INT_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+    DefineCustomBoolVariable("pg_curl.multiplex", "pg_curl multiplex", "Multiplex transfers over HTTP/2 connections?", &pg_curl.multiplex, true, PGC_USERSET, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.retry_after_max", "pg_curl retry after max", "Maximum wait asked by Retry-After or grown by backoff, when backoff has no max.", &pg_curl.retry_after_max, 60000, 1, INT_MAX, PGC_USERSET, GUC_UNIT_MS, NULL, NULL, NULL);
+    DefineCustomBoolVariable("pg_curl.pool", "pg_curl pool", "Keep multi handle with its connection cache across transactions?", &pg_curl.pool, false, PGC_USERSET, 0, NULL, NULL, NULL);
     DefineCustomBoolVariable("pg_curl.transaction", "pg_curl transaction", "Use transaction context?", &pg_curl.transaction, true, PGC_USERSET, 0, NULL, NULL, NULL);
+#if PG_VERSION_NUM >= 100000
+    DefineCustomRealVariable("pg_curl.breaker_failure_rate", "pg_curl breaker failure rate", "Share of failed transfers that opens the circuit breaker of a host (0 disables).", &pg_curl_breaker.failure_rate, 0, 0, 1, PGC_SIGHUP, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.breaker_hosts", "pg_curl breaker hosts", "Maximum number of hosts with circuit breaker.", &pg_curl_breaker.hosts, 64, 1, INT_MAX / 2, PGC_POSTMASTER, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.breaker_min_requests", "pg_curl breaker min requests", "Minimum number of transfers in the window before the circuit breaker opens.", &pg_curl_breaker.min_requests, 20, 1, INT_MAX, PGC_SIGHUP, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.breaker_open_time", "pg_curl breaker open time", "Time the circuit breaker stays open before a probe.", &pg_curl_breaker.open_time, 30000, 1, INT_MAX, PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.breaker_window", "pg_curl breaker window", "Time window of counted transfers.", &pg_curl_breaker.window, 60000, 1, INT_MAX, PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+    DefineCustomStringVariable("pg_curl.rate_limit", "pg_curl rate limit", "Requests per second and burst allowed to hosts of the whole cluster, like host=rate[/burst], * matches other hosts.", &pg_curl_limit.config, "", PGC_SIGHUP, 0, pg_curl_limit_check, pg_curl_limit_assign, NULL);
+    DefineCustomIntVariable("pg_curl.rate_limit_hosts", "pg_curl rate limit hosts", "Maximum number of rate limited hosts.", &pg_curl_limit.hosts, 64, 1, INT_MAX / 2, PGC_POSTMASTER, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.worker_async_limit", "pg_curl worker async limit", "Maximum number of asynchronous requests the worker performs at once.", &pg_curl_worker.async_limit, 100, 1, INT_MAX, PGC_SIGHUP, 0, NULL, NULL, NULL);
+    DefineCustomStringVariable("pg_curl.worker_database", "pg_curl worker database", "Database with the curl_async queue.", &pg_curl_worker.database, "postgres", PGC_POSTMASTER, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.worker_max_host_connections", "pg_curl worker max host connections", "Maximum number of worker connections to a single host (0 is unlimited).", &pg_curl_worker.max_host_connections, 0, 0, INT_MAX, PGC_SIGHUP, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.worker_max_total_connections", "pg_curl worker max total connections", "Maximum number of worker connections in total (0 is unlimited).", &pg_curl_worker.max_total_connections, 0, 0, INT_MAX, PGC_SIGHUP, 0, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.worker_naptime", "pg_curl worker naptime", "Interval between polls of the curl_async queue.", &pg_curl_worker.naptime, 1000, 1, INT_MAX, PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+    DefineCustomIntVariable("pg_curl.worker_queue_size", "pg_curl worker queue size", "Maximum number of requests waiting for the worker.", &pg_curl_worker.queue_size, 1024, 1, INT_MAX / 2, PGC_POSTMASTER, 0, NULL, NULL, NULL);
+    if (process_shared_preload_libraries_in_progress) {
+        BackgroundWorker worker = {0};
+        worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+        worker.bgw_restart_time = 10;
+        worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+        snprintf(worker.bgw_function_name, BGW_MAXLEN, "pg_curl_worker_main");
+        snprintf(worker.bgw_library_name, BGW_MAXLEN, "pg_curl");
+        snprintf(worker.bgw_name, BGW_MAXLEN, "pg_curl worker");
+#if PG_VERSION_NUM >= 110000
+        snprintf(worker.bgw_type, BGW_MAXLEN, "pg_curl worker");
+#endif
+        RegisterBackgroundWorker(&worker);
+#if PG_VERSION_NUM >= 150000
+        pg_curl_worker.shmem_request_hook = shmem_request_hook;
+        shmem_request_hook = pg_curl_worker_shmem_request;
+#else
+        RequestAddinShmemSpace(pg_curl_worker_shmem_size());
+        RequestAddinShmemSpace(pg_curl_limit_shmem_size());
+        RequestNamedLWLockTranche("pg_curl limit", 1);
+        RequestAddinShmemSpace(pg_curl_breaker_shmem_size());
+        RequestNamedLWLockTranche("pg_curl breaker", 1);
+#endif
+        pg_curl_worker.shmem_startup_hook = shmem_startup_hook;
+        shmem_startup_hook = pg_curl_worker_shmem_startup;
+    }
+#endif
 }
 #endif
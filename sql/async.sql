@@ -0,0 +1,14 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+BEGIN;
+select curl_async_submit('http://localhost/get', headers:='{"Accept":"application/json"}', try:=3) > 0;
+select url, method, headers, try, started, finished from curl_async_result(currval('curl_async_id_seq'));
+insert into curl_async (url, headers) values ('http://localhost/get', '{"a":{"b":"c"}}');
+ROLLBACK;
@@ -0,0 +1,71 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+select current_setting('shared_preload_libraries') ~ 'pg_curl' as breaker \gset
+\if :breaker
+ALTER SYSTEM SET pg_curl.breaker_failure_rate = 0.5;
+ALTER SYSTEM SET pg_curl.breaker_min_requests = 2;
+ALTER SYSTEM SET pg_curl.breaker_open_time = '1s';
+select pg_reload_conf();
+select true from pg_sleep(1.5);
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/base64/aGVsbG8=');
+select curl_easy_setopt_sink_file('/tmp/pg_curl_breaker.txt');
+select curl_easy_perform();
+BEGIN;
+SET LOCAL client_min_messages = ERROR;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/503');
+select curl_easy_setopt_retry_status();
+select curl_easy_perform(try := 3, sleep := 1000);
+select curl_easy_getinfo_errcode(), curl_easy_getinfo_attempts();
+END;
+DO $plpgsql$ BEGIN
+    PERFORM curl_easy_getinfo_response_code();
+EXCEPTION WHEN SQLSTATE 'XB000' THEN
+    RAISE WARNING 'retry rejected with %', SQLSTATE;
+END;$plpgsql$;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/base64/aGVsbG8=');
+select curl_easy_setopt_sink_file('/tmp/pg_curl_breaker.txt');
+DO $plpgsql$ BEGIN
+    PERFORM curl_easy_perform();
+EXCEPTION WHEN SQLSTATE 'XB000' THEN
+    RAISE WARNING 'request rejected with %', SQLSTATE;
+END;$plpgsql$;
+CREATE TEMP TABLE breaker_sink (line text);
+COPY breaker_sink FROM '/tmp/pg_curl_breaker.txt';
+select line from breaker_sink;
+select state, rejected >= 2 from curl_breaker where host = split_part(split_part(current_setting('pg_curl.httpbin'), '://', 2), '/', 1);
+select index, errcode, coalesce(errbuf, '') like 'circuit breaker of host % is open', convert_from(data_in, 'utf-8') from curl_multi_batch(array[current_setting('pg_curl.httpbin') || '/get', 'file:///tmp/pg_curl_breaker.txt']) order by index;
+select curl_easy_reset();
+select curl_easy_setopt_url(replace(current_setting('pg_curl.httpbin'), 'http', 'ws') || '/websocket/echo');
+DO $plpgsql$ BEGIN
+    PERFORM curl_ws_send('hello');
+EXCEPTION WHEN SQLSTATE 'XB000' THEN
+    RAISE WARNING 'handshake rejected with %', SQLSTATE;
+END;$plpgsql$;
+ALTER SYSTEM RESET pg_curl.breaker_failure_rate;
+ALTER SYSTEM RESET pg_curl.breaker_min_requests;
+ALTER SYSTEM RESET pg_curl.breaker_open_time;
+select pg_reload_conf();
+\endif
+select count(*) from curl_breaker where state not in ('closed', 'open', 'half-open');
@@ -0,0 +1,31 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+CREATE TEMP TABLE feed (i int, s text);
+select curl_copy_from(current_setting('pg_curl.httpbin') || '/base64/MSxhCjIsYgo=', 'feed', 'csv');
+select curl_copy_from(current_setting('pg_curl.httpbin') || '/base64/aTtzCjM7Ywo=', 'feed', 'csv', '{"header":true,"delimiter":";"}');
+select * from feed order by i;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/202');
+\set VERBOSITY terse
+select curl_copy_from(current_setting('pg_curl.httpbin') || '/status/404', 'feed', 'csv');
+\set VERBOSITY default
+select curl_easy_perform(), curl_easy_getinfo_response_code();
+select count(*) from feed;
@@ -0,0 +1,32 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/base64/eyJhIjogMX0=');
+select curl_easy_perform();
+select curl_easy_getinfo_data_in_jsonb()->'a';
+select curl_easy_getinfo_data_in_json()->'a';
+select curl_easy_getinfo_data_in_text();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/base64/6Q==');
+select curl_easy_perform();
+select curl_easy_getinfo_data_in_text('latin1') = U&'\00E9';
+select curl_easy_getinfo_data_in_jsonb();
+END;
@@ -0,0 +1,73 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+SET pg_curl.transaction = off;
+SET pg_curl.deferred = on;
+BEGIN;
+select curl_easy_reset(conname:='outbox');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/201', conname:='outbox');
+select curl_multi_add_handle(conname:='outbox');
+select curl_easy_getinfo_response_code(conname:='outbox');
+END;
+select curl_easy_getinfo_response_code(conname:='outbox');
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/202', conname:='outbox');
+select curl_multi_add_handle(conname:='outbox');
+ROLLBACK;
+select curl_easy_getinfo_response_code(conname:='outbox');
+BEGIN;
+SAVEPOINT s;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/203', conname:='outbox');
+select curl_multi_add_handle(conname:='outbox');
+ROLLBACK TO SAVEPOINT s;
+END;
+select curl_easy_getinfo_response_code(conname:='outbox');
+SET pg_curl.deferred_timeout = 100;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/delay/2', conname:='outbox');
+select curl_multi_add_handle(conname:='outbox');
+END;
+select curl_easy_getinfo_response_code(conname:='outbox');
+RESET pg_curl.deferred_timeout;
+COPY (select 'none') TO '/tmp/pg_curl_deferred_1.txt';
+COPY (select 'none') TO '/tmp/pg_curl_deferred_2.txt';
+COPY (select 'none') TO '/tmp/pg_curl_deferred_3.txt';
+BEGIN;
+select curl_easy_reset(conname:='outbox');
+select curl_easy_setopt_url('file:///tmp/pg_curl_deferred_1.txt', conname:='outbox');
+select curl_easy_setopt_readdata('first', conname:='outbox');
+select curl_multi_add_handle(conname:='outbox');
+select curl_easy_setopt_url('file:///tmp/pg_curl_deferred_2.txt', conname:='outbox');
+select curl_easy_setopt_readdata('second with a longer body', conname:='outbox');
+select curl_multi_add_handle(conname:='outbox');
+SAVEPOINT s;
+select curl_easy_setopt_url('file:///tmp/pg_curl_deferred_3.txt', conname:='outbox');
+select curl_easy_setopt_readdata('rolled back', conname:='outbox');
+select curl_multi_add_handle(conname:='outbox');
+ROLLBACK TO SAVEPOINT s;
+select curl_easy_reset(conname:='outbox');
+END;
+select curl_easy_getinfo_errcode(conname:='outbox');
+CREATE TEMP TABLE deferred_file (line text);
+COPY deferred_file FROM '/tmp/pg_curl_deferred_1.txt';
+COPY deferred_file FROM '/tmp/pg_curl_deferred_2.txt';
+COPY deferred_file FROM '/tmp/pg_curl_deferred_3.txt';
+select string_agg(line, '|') from deferred_file;
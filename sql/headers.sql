@@ -0,0 +1,33 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/response-headers?X-Test=a&X-Test=b');
+select curl_easy_perform();
+select curl_easy_getinfo_headers_jsonb()->'x-test';
+select curl_easy_header('x-test');
+select curl_easy_header('x-missing') is null;
+select count(*) from curl_easy_getinfo_headers_table() where lower(name) = 'x-test';
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/redirect-to?url=%2Fstatus%2F204');
+select curl_easy_setopt_followlocation(1);
+select curl_easy_perform();
+select max(response_index) from curl_easy_getinfo_headers_table();
+END;
@@ -29,3 +29,10 @@ select curl_multi_add_handle(conname:='1');
 select curl_multi_add_handle(conname:='2');
 select curl_multi_perform();
 END;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/delay/2', conname:='1');
+set statement_timeout = '1s';
+select curl_multi_add_handle(conname:='1');
+select curl_multi_perform(timeout_ms := 10000);
+END;
+select curl_multi_perform(timeout_ms := 0);
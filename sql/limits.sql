@@ -0,0 +1,36 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+SET pg_curl.max_response_bytes = 100;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/bytes/100');
+select curl_easy_perform();
+select length(curl_easy_getinfo_data_in());
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/bytes/101');
+select curl_easy_perform();
+select curl_easy_getinfo_errcode();
+select curl_easy_setopt_max_header_bytes(10);
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/bytes/1');
+select curl_easy_perform();
+select header > 0, response > 0 from curl_global_aborted();
+select curl_easy_getinfo_header_in();
+END;
@@ -0,0 +1,42 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+select index, errcode, response_code from curl_multi_batch(array[current_setting('pg_curl.httpbin') || '/status/200', current_setting('pg_curl.httpbin') || '/status/404', current_setting('pg_curl.httpbin') || '/post'], array['GET', 'GET', 'POST'], array[null, null, convert_to('{"a":"b"}', 'utf-8')], array[null, null, '{"Content-Type":"application/json; charset=utf-8"}']::jsonb[]) order by index;
+select convert_from(data_in, 'utf-8')::jsonb -> 'json' from curl_multi_batch(array[current_setting('pg_curl.httpbin') || '/post'], bodies:=array[convert_to('{"a":"b"}', 'utf-8')], headers:=array['{"Content-Type":"application/json"}'::jsonb]);
+select count(*) from curl_multi_batch(array[]::text[]);
+END;
+BEGIN;
+select curl_easy_reset(conname:='1');
+select curl_easy_reset(conname:='2');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/delay/1', conname:='1');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/404', conname:='2');
+select curl_multi_add_handle(conname:='1');
+select curl_multi_add_handle(conname:='2');
+select conname, errcode, response_code from curl_multi_info_read();
+END;
+BEGIN;
+select curl_easy_reset(conname:='1');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/202', conname:='1');
+select curl_multi_add_handle(conname:='1');
+select index, response_code from curl_multi_batch(array[current_setting('pg_curl.httpbin') || '/delay/1']);
+select conname, errcode, response_code from curl_multi_info_read();
+END;
@@ -0,0 +1,58 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+SET pg_curl.pool = on;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/get');
+select curl_easy_perform();
+select curl_easy_getinfo_num_connects();
+END;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/get');
+select curl_easy_perform();
+select curl_easy_getinfo_num_connects();
+END;
+select allocations > 0 and allocations >= frees from curl_global_memory();
+BEGIN;
+select curl_multi_setopt_max_host_connections(1), curl_multi_setopt_max_total_connections(2), curl_multi_setopt_maxconnects(4), curl_multi_setopt_pipelining(curlpipe_nothing()), curl_multi_setopt_max_concurrent_streams(10);
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/get');
+select curl_easy_perform();
+select curl_easy_getinfo_response_code();
+END;
+BEGIN;
+select curl_multi_setopt_maxconnects(NULL);
+END;
+SET pg_curl.pool = off;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/get');
+select curl_easy_perform();
+select curl_easy_getinfo_num_connects();
+END;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/get');
+select curl_easy_perform();
+select curl_easy_getinfo_num_connects();
+END;
@@ -0,0 +1,30 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+ALTER SYSTEM SET pg_curl.rate_limit = '*=1000/1';
+select pg_reload_conf();
+select true from pg_sleep(0.5);
+select curl_easy_reset();
+select count(*) from generate_series(1, 100) i, lateral (select curl_easy_setopt_url('http://127.0.0.' || i || ':1/'), curl_easy_perform()) p;
+select count(*) between 1 and current_setting('pg_curl.rate_limit_hosts')::int from curl_rate_limit;
+select count(*) from curl_rate_limit where tokens > burst;
+ALTER SYSTEM RESET pg_curl.rate_limit;
+select pg_reload_conf();
@@ -0,0 +1,46 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+select curl_easy_reset();
+select curl_easy_setopt_readquery('select 1', 'xml');
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/put');
+select curl_easy_setopt_readquery($$select i, 'a,b' s, null n from generate_series(1, 2) i$$);
+select curl_easy_perform();
+select convert_from(curl_easy_getinfo_data_in(), 'utf-8')::jsonb->>'data';
+END;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/put');
+select curl_easy_setopt_readquery($$select i, E'a\tb' s from generate_series(1, 2) i$$, 'json');
+select curl_easy_perform();
+select convert_from(curl_easy_getinfo_data_in(), 'utf-8')::jsonb->>'data';
+END;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/put');
+select curl_easy_setopt_readquery($$select 'x' c;$$, 'json');
+select curl_easy_perform();
+select convert_from(curl_easy_getinfo_data_in(), 'utf-8')::jsonb->>'data';
+END;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/put');
+select curl_easy_setopt_readquery($$select 1 / (2 - i) from generate_series(1, 3) i$$);
+select curl_easy_perform();
+ROLLBACK;
@@ -0,0 +1,71 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+SET LOCAL client_min_messages = ERROR;
+select curl_easy_reset();
+select curl_easy_setopt_url('http://localhost:1/');
+select curl_easy_setopt_backoff(2, 150000, jitter := 0);
+select set_config('retry.start', clock_timestamp()::text, true) is not null;
+select curl_easy_perform(try := 3, sleep := 100000);
+select clock_timestamp() - current_setting('retry.start')::timestamptz >= interval '250 ms';
+select curl_easy_getinfo_errcode(), curl_easy_getinfo_attempts();
+END;
+BEGIN;
+SET LOCAL client_min_messages = ERROR;
+SET LOCAL pg_curl.retry_after_max = 10;
+select curl_easy_reset();
+select curl_easy_setopt_url('http://localhost:1/');
+select curl_easy_setopt_backoff(1e300, 0, jitter := 0);
+select set_config('retry.start', clock_timestamp()::text, true) is not null;
+select curl_easy_perform(try := 5, sleep := 1000);
+select clock_timestamp() - current_setting('retry.start')::timestamptz < interval '10 s';
+select curl_easy_getinfo_errcode(), curl_easy_getinfo_attempts();
+END;
+BEGIN;
+select curl_easy_setopt_backoff(0.5);
+END;
+BEGIN;
+SET LOCAL client_min_messages = ERROR;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/503');
+select curl_easy_setopt_retry_status();
+select curl_easy_perform(try := 2, sleep := 1000);
+select curl_easy_getinfo_response_code(), curl_easy_getinfo_attempts();
+select curl_easy_setopt_postfields('a=b');
+select curl_easy_perform(try := 2, sleep := 1000);
+select curl_easy_getinfo_response_code(), curl_easy_getinfo_attempts();
+select curl_easy_setopt_retry_status(any_method := true);
+select curl_easy_perform(try := 2, sleep := 1000);
+select curl_easy_getinfo_response_code(), curl_easy_getinfo_attempts();
+END;
+BEGIN;
+select curl_easy_setopt_retry_status('{600}');
+END;
+BEGIN;
+SET LOCAL client_min_messages = ERROR;
+SET LOCAL pg_curl.retry_after_max = 100;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/response-headers?Retry-After=3600');
+select curl_easy_setopt_retry_status('{200}');
+select curl_easy_perform(try := 2, sleep := 1000);
+select curl_easy_getinfo_response_code(), curl_easy_getinfo_attempts();
+END;
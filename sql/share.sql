@@ -0,0 +1,64 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+select curl_share_setopt_share(curl_lock_data_cookie());
+select curl_easy_reset(conname:='1');
+select curl_easy_reset(conname:='2');
+select curl_easy_setopt_cookiefile('', conname:='1');
+select curl_easy_setopt_cookiefile('', conname:='2');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/cookies/set?a=b', conname:='1');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/cookies', conname:='2');
+select curl_multi_add_handle(conname:='1');
+select curl_multi_perform();
+select curl_multi_add_handle(conname:='2');
+select curl_multi_perform();
+select convert_from(curl_easy_getinfo_data_in(conname:='2'), 'utf-8')::jsonb->'cookies';
+select curl_share_setopt_unshare(curl_lock_data_cookie());
+END;
+BEGIN;
+select curl_easy_reset(conname:='1');
+select curl_easy_reset(conname:='2');
+select curl_easy_setopt_cookiefile('', conname:='1');
+select curl_easy_setopt_cookiefile('', conname:='2');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/cookies/set?a=b', conname:='1');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/cookies', conname:='2');
+select curl_multi_add_handle(conname:='1');
+select curl_multi_perform();
+select curl_multi_add_handle(conname:='2');
+select curl_multi_perform();
+select convert_from(curl_easy_getinfo_data_in(conname:='2'), 'utf-8')::jsonb->'cookies';
+END;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/get');
+select curl_easy_perform();
+select curl_share_cleanup();
+select curl_share_cleanup();
+select curl_easy_perform();
+select curl_easy_getinfo_response_code();
+END;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/get');
+select curl_multi_add_handle();
+select curl_share_cleanup();
+END;
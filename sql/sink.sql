@@ -0,0 +1,48 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+select lo_create(0) as loid \gset
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/base64/aGVsbG8=');
+select curl_easy_setopt_sink_lo(:loid);
+select curl_easy_perform();
+select convert_from(lo_get(:loid), 'utf-8');
+select curl_easy_getinfo_data_in() is null;
+select curl_easy_setopt_sink_tempfile();
+select curl_easy_perform();
+select string_agg(convert_from(c, 'utf-8'), '|') from curl_easy_getinfo_data_in_chunks(2) c;
+select lo_unlink(:loid);
+END;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/base64/aGVsbG8=');
+select curl_easy_perform();
+select convert_from(curl_easy_getinfo_data_in_take(), 'utf-8');
+select curl_easy_getinfo_data_in() is null;
+END;
+BEGIN;
+CREATE ROLE pg_curl_sink;
+select curl_easy_reset();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/base64/aGVsbG8=');
+select curl_easy_setopt_sink_file('/dev/null');
+SET LOCAL ROLE pg_curl_sink;
+select curl_easy_perform();
+ROLLBACK;
@@ -0,0 +1,62 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/stream/3');
+select count(*) from curl_stream_lines();
+select j->>'id' from curl_stream_jsonb() j;
+select j->>'id' from curl_stream_jsonb() j limit 1;
+select count(*) from curl_stream_lines();
+END;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/204');
+select count(*) from curl_stream_sse();
+select count(*) from curl_stream_sse(max_time_ms := 1000);
+END;
+BEGIN;
+select count(*) from curl_stream_sse(0);
+END;
+BEGIN;
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/stream/3');
+select count(*) from curl_stream_sse();
+END;
+BEGIN;
+select curl_easy_reset(conname:='1');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/202', conname:='1');
+select curl_multi_add_handle(conname:='1');
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/drip?numbytes=3&duration=1&delay=0');
+select * from curl_stream_lines();
+select curl_easy_getinfo_data_in() is null;
+select conname, errcode, response_code from curl_multi_info_read();
+END;
+COPY (select unnest(array[': keep alive', 'retry: 10', 'data: first', '', 'event: greeting', 'data: hello', 'data: world', 'id: 2', '', 'data: third', 'id: 3', '', 'data: incomplete'])) TO '/tmp/pg_curl_sse.txt';
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_url('file:///tmp/pg_curl_sse.txt');
+select id, event, replace(data, E'\n', '+') from curl_stream_sse(max_rows := 4);
+END;
+BEGIN;
+select curl_easy_reset();
+select curl_easy_setopt_verbose(1);
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/response-headers?Content-Type=text/event-stream');
+select count(*) from curl_stream_sse(max_time_ms := 1000, last_event_id := '42');
+select curl_easy_getinfo_header_out() like '%Last-Event-ID: 42%';
+END;
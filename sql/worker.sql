@@ -0,0 +1,30 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+BEGIN;
+select errcode, response_code from curl_worker_perform(current_setting('pg_curl.httpbin') || '/status/202');
+END;
+BEGIN;
+select errcode from curl_worker_perform(current_setting('pg_curl.httpbin') || '/get?' || repeat('a', 8000001));
+END;
+BEGIN;
+select errcode, response_code from curl_worker_perform(current_setting('pg_curl.httpbin') || '/status/202');
+END;
@@ -0,0 +1,51 @@
+\unset ECHO
+\set QUIET 1
+\pset format unaligned
+\pset tuples_only true
+\pset pager off
+BEGIN;
+SET LOCAL client_min_messages = WARNING;
+CREATE EXTENSION IF NOT EXISTS pg_curl;
+END;
+DO $plpgsql$ BEGIN
+    BEGIN
+        PERFORM curl_easy_reset();
+        PERFORM curl_easy_setopt_timeout(1);
+        PERFORM curl_easy_setopt_url('http://localhost/status/202');
+        PERFORM curl_easy_perform();
+        PERFORM curl_easy_getinfo_http_connectcode();
+        SET pg_curl.httpbin = 'http://localhost';
+    EXCEPTION WHEN OTHERS THEN
+        SET pg_curl.httpbin = 'https://httpbin.org';
+    END;
+END;$plpgsql$;
+select curl_ws_close();
+select curl_ws_send('hello', 'bogus');
+select curl_easy_reset();
+select curl_easy_setopt_url(replace(current_setting('pg_curl.httpbin'), 'http', 'ws') || '/status/202');
+\set VERBOSITY terse
+select curl_ws_send('hello');
+\set VERBOSITY default
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/202');
+select curl_easy_perform(), curl_easy_getinfo_response_code();
+DO $plpgsql$ BEGIN
+    PERFORM curl_easy_reset(conname:='ws');
+    PERFORM curl_easy_setopt_url(replace(current_setting('pg_curl.httpbin'), 'http', 'ws') || '/websocket/echo', conname:='ws');
+    PERFORM curl_ws_send('probe', conname:='ws');
+    PERFORM curl_ws_close(conname:='ws');
+    SET pg_curl.ws = 'on';
+EXCEPTION WHEN OTHERS THEN
+    SET pg_curl.ws = 'off';
+END;$plpgsql$;
+select current_setting('pg_curl.ws') as ws \gset
+\if :ws
+select curl_easy_reset();
+select curl_easy_setopt_url(replace(current_setting('pg_curl.httpbin'), 'http', 'ws') || '/websocket/echo');
+select curl_ws_send('hello');
+select curl_ws_send('\x0102'::bytea);
+select curl_ws_send('ping', 'ping');
+select opcode, payload from curl_ws_recv(timeout_ms := 5000, max_messages := 3);
+select curl_ws_close();
+select curl_easy_setopt_url(current_setting('pg_curl.httpbin') || '/status/202');
+select curl_easy_perform(), curl_easy_getinfo_response_code();
+\endif